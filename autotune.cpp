@@ -0,0 +1,248 @@
+//////////////////////////////
+//** AUTOTUNE SOURCE FILE ** //
+//////////////////////////////
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <unistd.h>
+#include "autotune.h"
+
+using namespace std;
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+/*
+Returns the CPU model from the "model name" line of /proc/cpuinfo, with whitespace replaced by '_'.
+Returns "unknown" if it cannot be read.
+*/
+string get_cpu_model(){
+    ifstream cpuinfo("/proc/cpuinfo");
+
+    string line;
+    while ( getline(cpuinfo,line) ){
+        if (line.rfind("model name",0) != 0){
+            continue;
+        }
+
+        size_t pos = line.find(':');
+        if (pos == string::npos){
+            break;
+        }
+
+        // Strip the value and replace whitespace such that the model can be used in a key
+        string cpu_model;
+        istringstream iss( line.substr(pos+1) );
+        string word;
+        while (iss >> word){
+            cpu_model += (cpu_model.empty() ? "" : "_") + word;
+        }
+
+        if (!cpu_model.empty()){
+            return cpu_model;
+        }
+    }
+
+    return "unknown";
+}
+
+
+/*
+Makes the synthetic traces of the autotuner benchmark.
+Each trace contains Gaussian noise and a random desampled template, with its peak in the middle of the trace.
+
+Arguments
+---------
+`templates_desampled` : Desampled templates, see `TemplateFLT::desample_templates`.
+
+`sample_peak_template_desampled` : Sample of peak position of a desampled template.
+
+`size_trace` : Number of samples of a trace.
+
+`n_traces` : Number of traces.
+
+`seed` : Seed of the random number generator.
+
+`traces` : Set to the traces.
+
+`t_maxs` : Set to the position of the trace maximum of each trace.
+*/
+void make_autotune_traces(const vector< vector< Eigen::ArrayXf > >& templates_desampled,
+                          const int& sample_peak_template_desampled,
+                          const int& size_trace,
+                          const int& n_traces,
+                          const unsigned int& seed,
+                          vector<Eigen::ArrayXi>& traces,
+                          vector<int>& t_maxs){
+    mt19937 rng(seed);
+    normal_distribution<float> noise(0,5);
+    uniform_real_distribution<float> amplitude(20,200);
+
+    traces.clear();
+    t_maxs.clear();
+    for (int n=0; n<n_traces; n++){
+        Eigen::ArrayXf trace(size_trace);
+        for (int k=0; k<size_trace; k++){
+            trace(k) = noise(rng);
+        }
+
+        // Inject a random desampled template with its peak in the middle of the trace
+        int t_max = size_trace/2;
+        if (!templates_desampled.empty()){
+            const vector< Eigen::ArrayXf >& template_set = templates_desampled[ rng() % templates_desampled.size() ];
+            const Eigen::ArrayXf& templ = template_set[ rng() % template_set.size() ];
+            int start = t_max - sample_peak_template_desampled;
+            int size = min( (int)templ.size(),size_trace-start );
+            trace.segment(start,size) += templ.head(size) / templ.abs().maxCoeff() * amplitude(rng);
+        }
+
+        traces.push_back( trace.round().cast<int>() );
+        t_maxs.push_back(t_max);
+    }
+
+    return;
+}
+
+
+/*
+Reads the decision for a key from the cache file of the autotuner.
+
+Arguments
+---------
+`cache_file` : Path to the cache file.
+
+`key` : Key of the decision.
+
+`result` : Set to the cached decision if it is found.
+
+Returns
+-------
+`found` : True if the key is found in the cache file.
+*/
+bool load_autotune_result(const string& cache_file,
+                          const string& key,
+                          AutotuneResult& result){
+    ifstream file(cache_file);
+
+    string line;
+    while ( getline(file,line) ){
+        istringstream iss(line);
+
+        AutotuneResult cached;
+        int n_timings;
+        if ( !(iss >> cached.key >> cached.fit_engine >> cached.size_block >> n_timings) || cached.key != key ){
+            continue;
+        }
+
+        bool valid = true;
+        for (int i=0; i<n_timings && valid; i++){
+            AutotuneTiming timing;
+            valid = (bool)(iss >> timing.fit_engine >> timing.size_block >> timing.time_per_fit);
+            cached.timings.push_back(timing);
+        }
+
+        if (valid){
+            cached.from_cache = true;
+            result = cached;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+Writes a decision to the cache file of the autotuner.
+A previous decision with the same key is replaced. Nothing is written if the file cannot be opened.
+The file is written to a temporary file in the same directory, which is then renamed to the cache file,
+such that a reader never sees a partially written cache file.
+
+Arguments
+---------
+`cache_file` : Path to the cache file.
+
+`result` : Decision of the autotuner.
+*/
+void save_autotune_result(const string& cache_file,
+                          const AutotuneResult& result){
+    // Keep the decisions of all other keys
+    vector<string> lines;
+    {
+        ifstream file(cache_file);
+        string line;
+        while ( getline(file,line) ){
+            istringstream iss(line);
+            string key;
+            if (iss >> key && key != result.key){
+                lines.push_back(line);
+            }
+        }
+    }
+
+    ostringstream oss;
+    oss << result.key << " " << result.fit_engine << " " << result.size_block << " " << result.timings.size();
+    for (const AutotuneTiming& timing : result.timings){
+        oss << " " << timing.fit_engine << " " << timing.size_block << " " << timing.time_per_fit;
+    }
+    lines.push_back( oss.str() );
+
+    // Write a temporary file unique to this process, and rename it to the cache file
+    string tmp_file = cache_file + ".tmp." + to_string( getpid() );
+    {
+        ofstream file(tmp_file);
+        for (const string& line : lines){
+            file << line << "\n";
+        }
+        file.close();
+        if (!file){
+            cout << ">>> Could not write autotune cache file: " << tmp_file << endl;
+            remove( tmp_file.c_str() );
+            return;
+        }
+    }
+    if (rename( tmp_file.c_str(),cache_file.c_str() ) != 0){
+        cout << ">>> Could not write autotune cache file: " << cache_file << endl;
+        remove( tmp_file.c_str() );
+    }
+
+    return;
+}
+
+
+/*
+Prints the decision of the autotuner and the measured times of all candidates.
+
+Arguments
+---------
+`result` : Decision of the autotuner.
+*/
+void print_autotune_result(const AutotuneResult& result){
+    streamsize precision = cout.precision();
+
+    cout << ">>> Autotune selected the " << result.fit_engine << " engine";
+    if (result.fit_engine == "packed"){
+        cout << " with " << (result.size_block > 0 ? to_string(result.size_block) : "all") << " templates per block";
+    }
+    cout << (result.from_cache ? " (cached)" : "") << endl;
+
+    for (const AutotuneTiming& timing : result.timings){
+        cout << "    " << timing.fit_engine;
+        if (timing.fit_engine == "packed"){
+            cout << "/" << (timing.size_block > 0 ? to_string(timing.size_block) : "all");
+        }
+        cout << ": " << fixed << setprecision(2) << timing.time_per_fit << " us/fit" << endl;
+        cout.unsetf(ios::floatfield);
+        cout.precision(precision);
+    }
+
+    return;
+}
@@ -0,0 +1,96 @@
+/*
+//////////////////////////////
+//** AUTOTUNE HEADER FILE ** //
+//////////////////////////////
+
+This file defines the autotuner of the Template FLT-1, see `TemplateFLT::autotune`.
+The fastest correlation engine depends on the number of templates, the correlation window,
+the desampling factor and the host CPU. At startup, the autotuner times all engines that yield the
+same result as the reference engine (and the block sizes of the packed engine) on synthetic traces
+for the actual configuration, and selects the fastest one whose fits agree with the reference engine
+on the same traces.
+
+The decision is cached in a txt file, one line per key. The key contains the CPU model
+(from /proc/cpuinfo) and the configuration of the template fit, including the preprocessing, such that
+the benchmark only runs once per host and configuration. The file is replaced atomically (write to
+a temporary file, then rename). A line naming an unknown engine is ignored. Each line of the cache file reads:
+    <key> <fit_engine> <size_block> <n_timings> <fit_engine_1> <size_block_1> <time_per_fit_1> ...
+*/
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <vector>
+#include <string>
+#include <eigen3/Eigen/Dense>
+
+/*
+-------
+STRUCTS
+-------
+*/
+
+// Configuration of the autotuner
+struct AutotuneConfig{
+    // Run the autotuner when the templates are desampled
+    bool enabled = false;
+    // Path to the cache file of the decisions, empty = no cache
+    std::string cache_file = "template_flt_autotune.txt";
+    // Number of synthetic traces of the benchmark
+    int n_traces = 64;
+    // Number of timed passes over the synthetic traces, the fastest pass is kept
+    int n_repeats = 3;
+    // Seed of the synthetic traces
+    unsigned int seed = 1;
+};
+
+// Measured time of one candidate of the autotuner
+struct AutotuneTiming{
+    // Name of the correlation engine, see `fit_engine_name`
+    std::string fit_engine;
+    // Number of templates per matrix product of the packed engine, 0 = all templates
+    int size_block = 0;
+    // Time per template fit [us]
+    double time_per_fit = 0;
+};
+
+// Decision of the autotuner
+struct AutotuneResult{
+    // Key of the decision in the cache file: CPU model and configuration
+    std::string key;
+    // Name of the selected correlation engine, empty if the autotuner did not run
+    std::string fit_engine;
+    // Selected number of templates per matrix product of the packed engine
+    int size_block = 0;
+    // Whether the decision was read from the cache file
+    bool from_cache = false;
+    // Measured times of all candidates
+    std::vector<AutotuneTiming> timings;
+};
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+std::string get_cpu_model();
+
+void make_autotune_traces(const std::vector< std::vector< Eigen::ArrayXf > >& templates_desampled,
+                          const int& sample_peak_template_desampled,
+                          const int& size_trace,
+                          const int& n_traces,
+                          const unsigned int& seed,
+                          std::vector<Eigen::ArrayXi>& traces,
+                          std::vector<int>& t_maxs);
+
+bool load_autotune_result(const std::string& cache_file,
+                          const std::string& key,
+                          AutotuneResult& result);
+
+void save_autotune_result(const std::string& cache_file,
+                          const AutotuneResult& result);
+
+void print_autotune_result(const AutotuneResult& result);
+
+#endif // AUTOTUNE_H
@@ -0,0 +1,440 @@
+//////////////////////////////
+//** DECISION SOURCE FILE ** //
+//////////////////////////////
+
+#include <fstream>
+#include <sstream>
+#include <limits>
+#include "decision.h"
+#include "error_handling.h"
+
+using namespace std;
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+/*
+Makes a threshold table with the same threshold for all detector units, channels and template groups.
+
+Arguments
+---------
+`n_units` : Number of detector units. Must be >= 1.
+
+`n_channels` : Number of channels per detector unit. Default is 2 (X and Y polarizations).
+
+`corr_thresh` : Correlation threshold of all entries. Must be between [0,1]. Default is 0.
+
+`template_groups` : Group of each template ID, must be >= 0. Default is empty = all templates in group 0.
+*/
+ThresholdTable make_threshold_table(const int& n_units,
+                                    const int& n_channels,
+                                    const float& corr_thresh,
+                                    const vector<int>& template_groups){
+    // Check the dimensions of the table
+    if (n_units < 1 || n_channels < 1){
+        string err_msg = "Threshold table needs n_units >= 1 and n_channels >= 1!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    // Check the template groups before the number of groups is derived from them
+    for (const int& group : template_groups){
+        if (group < 0){
+            string err_msg = "Template groups must be >= 0!";
+            throwError(err_msg,__FILE__,__LINE__);
+        }
+    }
+
+    ThresholdTable table;
+    table.n_units = n_units;
+    table.n_channels = n_channels;
+    table.template_groups = Eigen::Map<const Eigen::ArrayXi>(template_groups.data(),template_groups.size());
+    table.n_groups = template_groups.empty() ? 1 : table.template_groups.maxCoeff() + 1;
+    table.thresholds = Eigen::ArrayXf::Constant(n_units*n_channels*table.n_groups,corr_thresh);
+
+    return table;
+}
+
+
+/*
+Adds the fit result of one trace to a batch.
+A trace that was not fitted or that was rejected by the pre-filter is added with template ID 0
+and a correlation of -infinity, such that it is never triggered.
+
+Arguments
+---------
+`batch` : Batch of fit results.
+
+`unit` : Detector unit of the trace.
+
+`channel` : Channel of the trace.
+
+`result` : Fit result of the trace.
+*/
+void add_to_batch(DecisionBatch& batch,
+                  const int& unit,
+                  const int& channel,
+                  const FitResult& result){
+    bool decidable = result.n_templates_evaluated > 0 && !result.rejected_prefilter;
+
+    batch.units.push_back(unit);
+    batch.channels.push_back(channel);
+    batch.template_ids.push_back( decidable ? result.template_id_best : 0 );
+    batch.corr_max.push_back( decidable ? result.corr_max_best : -numeric_limits<float>::infinity() );
+
+    return;
+}
+
+
+/*
+Removes all fit results from a batch, keeping its memory.
+
+Arguments
+---------
+`batch` : Batch of fit results.
+*/
+void clear_batch(DecisionBatch& batch){
+    batch.units.clear();
+    batch.channels.clear();
+    batch.template_ids.clear();
+    batch.corr_max.clear();
+
+    return;
+}
+
+
+/*
+Gets the threshold of a fit result from a threshold table.
+
+Arguments
+---------
+`table` : Threshold table, e.g. a snapshot of `DecisionStage::get_table`.
+
+`unit` : Detector unit of the trace.
+
+`channel` : Channel of the trace.
+
+`template_id` : ID of the best-fit template.
+
+Returns
+-------
+`corr_thresh` : Threshold of the unit, channel and template group.
+*/
+float get_threshold(const ThresholdTable& table,
+                    const int& unit,
+                    const int& channel,
+                    const int& template_id){
+    // Check that the entry exists
+    if (unit < 0 || unit >= table.n_units || channel < 0 || channel >= table.n_channels
+        || ( table.template_groups.size() > 0 && (template_id < 0 || template_id >= table.template_groups.size()) )){
+        string err_msg = "Invalid fit result: unit=" + to_string(unit) + ", channel=" + to_string(channel) + ", template_id=" + to_string(template_id);
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    int group = table.template_groups.size() > 0 ? table.template_groups(template_id) : 0;
+
+    return table.thresholds( (unit*table.n_channels + channel)*table.n_groups + group );
+}
+
+
+/*
+Trigger decisions for a batch of fit results with a threshold table, in one vectorized pass.
+
+Arguments
+---------
+`table` : Threshold table, e.g. a snapshot of `DecisionStage::get_table`.
+
+`batch` : Batch of fit results, see `add_to_batch`.
+
+`decisions` : Set to the decision of each fit result of the batch.
+
+Returns
+-------
+`n_triggered` : Number of triggered fit results.
+*/
+int decide_batch(const ThresholdTable& table,
+                 const DecisionBatch& batch,
+                 ArrayXb& decisions){
+    // Check that all fields of the batch have the same size
+    size_t n = batch.corr_max.size();
+    if (batch.units.size() != n || batch.channels.size() != n || batch.template_ids.size() != n){
+        string err_msg = "All fields of a decision batch must have the same size!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    // Views of the batch without copy
+    Eigen::Map<const Eigen::ArrayXi> units(batch.units.data(),n);
+    Eigen::Map<const Eigen::ArrayXi> channels(batch.channels.data(),n);
+    Eigen::Map<const Eigen::ArrayXi> template_ids(batch.template_ids.data(),n);
+    Eigen::Map<const Eigen::ArrayXf> corr_max(batch.corr_max.data(),n);
+
+    // Check that all entries exist, negative values are out of range as unsigned
+    bool valid = (units.cast<unsigned int>() < (unsigned int)table.n_units).all()
+                 && (channels.cast<unsigned int>() < (unsigned int)table.n_channels).all();
+    if (table.template_groups.size() > 0){
+        valid = valid && (template_ids.cast<unsigned int>() < (unsigned int)table.template_groups.size()).all();
+    }
+    if (!valid){
+        string err_msg = "Invalid unit, channel or template ID in decision batch!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    // Index of the threshold of each fit result
+    Eigen::ArrayXi idx = (units*table.n_channels + channels)*table.n_groups;
+    if (table.template_groups.size() > 0){
+        idx += table.template_groups(template_ids);
+    }
+
+    decisions = corr_max > table.thresholds(idx);
+
+    return decisions.count();
+}
+
+
+/*
+------------
+CONSTRUCTORS
+------------
+*/
+
+/*
+Constructor that publishes the initial threshold table.
+
+Arguments
+---------
+`table` : Initial threshold table, see `make_threshold_table`.
+*/
+DecisionStage::DecisionStage(const ThresholdTable& table){
+    set_table(table);
+}
+
+
+/*
+-------
+SETTERS
+-------
+*/
+
+/*
+Publishes a new threshold table.
+Decisions in progress finish with the previous table, the following ones use the new table.
+
+Arguments
+---------
+`table` : New threshold table.
+*/
+void DecisionStage::set_table(const ThresholdTable& table){
+    check_table(table);
+
+    lock_guard<mutex> lock(mutex_update);
+
+    shared_ptr<ThresholdTable> table_new = make_shared<ThresholdTable>(table);
+    shared_ptr<const ThresholdTable> table_old = atomic_load(&this->table);
+    table_new->version = table_old ? table_old->version + 1 : 0;
+
+    atomic_store( &this->table,shared_ptr<const ThresholdTable>(table_new) );
+
+    return;
+}
+
+
+/*
+Publishes a copy of the current threshold table with one threshold changed.
+
+Arguments
+---------
+`unit` : Detector unit.
+
+`channel` : Channel of the detector unit.
+
+`group` : Template group.
+
+`corr_thresh` : New correlation threshold. Must be between [0,1].
+*/
+void DecisionStage::set_threshold(const int& unit,
+                                  const int& channel,
+                                  const int& group,
+                                  const float& corr_thresh){
+    // Check that threshold is within [0,1]
+    if (corr_thresh < 0 || corr_thresh > 1){
+        string err_msg = "Correlation threshold must be between [0,1]!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    lock_guard<mutex> lock(mutex_update);
+
+    shared_ptr<ThresholdTable> table_new = make_shared<ThresholdTable>( *atomic_load(&this->table) );
+
+    // Check that the entry exists
+    if (unit < 0 || unit >= table_new->n_units || channel < 0 || channel >= table_new->n_channels || group < 0 || group >= table_new->n_groups){
+        string err_msg = "Invalid threshold table entry: unit=" + to_string(unit) + ", channel=" + to_string(channel) + ", group=" + to_string(group);
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    table_new->thresholds( (unit*table_new->n_channels + channel)*table_new->n_groups + group ) = corr_thresh;
+    table_new->version++;
+
+    atomic_store( &this->table,shared_ptr<const ThresholdTable>(table_new) );
+
+    return;
+}
+
+
+/*
+-------
+GETTERS
+-------
+*/
+
+/*
+Getter for a snapshot of the current threshold table.
+*/
+shared_ptr<const ThresholdTable> DecisionStage::get_table() const{
+    return atomic_load(&this->table);
+}
+
+
+/*
+-------
+METHODS
+-------
+*/
+
+/*
+Checks that the dimensions, template groups and thresholds of a table are consistent.
+
+Arguments
+---------
+`table` : Threshold table.
+*/
+void DecisionStage::check_table(const ThresholdTable& table){
+    if (table.n_units < 1 || table.n_channels < 1 || table.n_groups < 1){
+        string err_msg = "Threshold table needs n_units, n_channels and n_groups >= 1!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    if (table.thresholds.size() != table.n_units*table.n_channels*table.n_groups){
+        string err_msg = "Threshold table has " + to_string(table.thresholds.size()) + " thresholds instead of n_units*n_channels*n_groups = "
+                         + to_string(table.n_units*table.n_channels*table.n_groups);
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    if ( table.template_groups.size() > 0 && ( (table.template_groups < 0).any() || (table.template_groups >= table.n_groups).any() ) ){
+        string err_msg = "Template groups must be between [0,n_groups)!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    if ( (table.thresholds < 0).any() || (table.thresholds > 1).any() ){
+        string err_msg = "Correlation thresholds must be between [0,1]!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    return;
+}
+
+
+/*
+Publishes a copy of the current threshold table with the thresholds of a txt file.
+Each line of the file reads `unit channel group corr_thresh`. A negative unit, channel or group
+applies the threshold to all units, channels or groups. Lines starting with '#' are skipped.
+All lines are applied to the same copy, such that the update is atomic.
+
+Arguments
+---------
+`threshold_file_name` : Path to the txt file storing the thresholds.
+*/
+void DecisionStage::load_thresholds(const string& threshold_file_name){
+    // Instance of threshold file
+    ifstream threshold_file(threshold_file_name);
+
+    // Check if the file opened successfully
+    if (!threshold_file){
+        string err_msg = "Error opening threshold file: " + threshold_file_name;
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    lock_guard<mutex> lock(mutex_update);
+
+    shared_ptr<ThresholdTable> table_new = make_shared<ThresholdTable>( *atomic_load(&this->table) );
+    ThresholdTable& t = *table_new;
+
+    string line;
+    while ( getline(threshold_file,line) ){
+        if (line.empty() || line[0] == '#'){
+            continue;
+        }
+
+        istringstream iss(line);
+        int unit, channel, group;
+        float corr_thresh;
+        if ( !(iss >> unit >> channel >> group >> corr_thresh) ){
+            string err_msg = "Invalid line in threshold file " + threshold_file_name + ": " + line;
+            throwError(err_msg,__FILE__,__LINE__);
+        }
+        if (unit >= t.n_units || channel >= t.n_channels || group >= t.n_groups || corr_thresh < 0 || corr_thresh > 1){
+            string err_msg = "Invalid threshold in threshold file " + threshold_file_name + ": " + line;
+            throwError(err_msg,__FILE__,__LINE__);
+        }
+
+        // Loop over all entries selected by the line
+        for (int u = max(unit,0); u < (unit < 0 ? t.n_units : unit+1); u++){
+            for (int c = max(channel,0); c < (channel < 0 ? t.n_channels : channel+1); c++){
+                for (int g = max(group,0); g < (group < 0 ? t.n_groups : group+1); g++){
+                    t.thresholds( (u*t.n_channels + c)*t.n_groups + g ) = corr_thresh;
+                }
+            }
+        }
+    }
+
+    t.version++;
+
+    atomic_store( &this->table,shared_ptr<const ThresholdTable>(table_new) );
+
+    return;
+}
+
+
+/*
+Trigger decision for the fit result of one trace.
+
+Arguments
+---------
+`unit` : Detector unit of the trace.
+
+`channel` : Channel of the trace.
+
+`template_id` : ID of the best-fit template.
+
+`corr_max` : Maximum correlation of the best-fit template.
+
+Returns
+-------
+`decision` : True if `corr_max` > the threshold of the unit, channel and template group.
+*/
+bool DecisionStage::decide(const int& unit,
+                           const int& channel,
+                           const int& template_id,
+                           const float& corr_max) const{
+    shared_ptr<const ThresholdTable> table = atomic_load(&this->table);
+
+    return corr_max > get_threshold(*table,unit,channel,template_id);
+}
+
+
+/*
+Trigger decisions for a batch of fit results, with one snapshot of the current threshold table, see `decide_batch`.
+
+Arguments
+---------
+`batch` : Batch of fit results, see `add_to_batch`.
+
+`decisions` : Set to the decision of each fit result of the batch.
+
+Returns
+-------
+`n_triggered` : Number of triggered fit results.
+*/
+int DecisionStage::decide(const DecisionBatch& batch,
+                          ArrayXb& decisions) const{
+    shared_ptr<const ThresholdTable> table = atomic_load(&this->table);
+
+    return decide_batch(*table,batch,decisions);
+}
@@ -0,0 +1,158 @@
+/*
+//////////////////////////////
+//** DECISION HEADER FILE ** //
+//////////////////////////////
+
+This file defines the decision stage of the Template FLT-1.
+In production, the correlation thresholds are tuned per detector unit and per channel (polarization)
+from the local noise conditions, and optionally per group of templates.
+The decision stage keeps these thresholds in a compact table, and applies them to batches of fit results
+in one vectorized pass (`decide_batch`): the table index of each fit result is computed, the thresholds are gathered,
+and all decisions are made at once.
+
+A trigger thread fits the traces of a batch with `TemplateFLT::trigger`, collects the fit results in a `DecisionBatch`
+with `add_to_batch`, and decides the batch with `decide_batch` on a snapshot of the table. Traces that were not fitted
+or that were rejected by the pre-filter are never triggered. In verification mode of the pre-filter, `TemplateFLT::trigger`
+looks up the thresholds of the rejected traces in the same snapshot with `get_threshold`, such that the false vetoes
+are counted with the thresholds of the decisions.
+
+The threshold table is immutable once published. The monitoring system updates it by publishing a new table
+with `std::atomic_store` on a `std::shared_ptr`, while the trigger threads take a snapshot with
+`std::atomic_load` once per batch. Trigger processing is never paused, and a batch is always decided
+with one consistent table.
+*/
+
+#ifndef DECISION_H
+#define DECISION_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <eigen3/Eigen/Dense>
+#include "template_FLT.h"
+
+/*
+-------
+STRUCTS
+-------
+*/
+
+// Array of decisions
+typedef Eigen::Array<bool,Eigen::Dynamic,1> ArrayXb;
+
+// Table of correlation thresholds per detector unit, channel and template group
+struct ThresholdTable{
+    // Number of detector units, channels per unit and template groups
+    int n_units = 0;
+    int n_channels = 0;
+    int n_groups = 0;
+    // Group of each template ID, empty = all templates in group 0
+    Eigen::ArrayXi template_groups;
+    // Thresholds, index = (unit*n_channels + channel)*n_groups + group
+    Eigen::ArrayXf thresholds;
+    // Version of the table, incremented by each update of the decision stage
+    long version = 0;
+};
+
+// Fit results of a batch of traces, stored as one array per field
+struct DecisionBatch{
+    std::vector<int> units;
+    std::vector<int> channels;
+    std::vector<int> template_ids;
+    std::vector<float> corr_max;
+};
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+ThresholdTable make_threshold_table(const int& n_units,
+                                    const int& n_channels = 2,
+                                    const float& corr_thresh = 0,
+                                    const std::vector<int>& template_groups = {});
+
+void add_to_batch(DecisionBatch& batch,
+                  const int& unit,
+                  const int& channel,
+                  const FitResult& result);
+
+void clear_batch(DecisionBatch& batch);
+
+int decide_batch(const ThresholdTable& table,
+                 const DecisionBatch& batch,
+                 ArrayXb& decisions);
+
+float get_threshold(const ThresholdTable& table,
+                    const int& unit,
+                    const int& channel,
+                    const int& template_id);
+
+class DecisionStage{
+    private:
+        /*
+        ------------------
+        PRIVATE ATTRIBUTES
+        ------------------
+        */
+
+        // Current threshold table, only accessed with `std::atomic_load` and `std::atomic_store`
+        std::shared_ptr<const ThresholdTable> table;
+        // Serializes the updates of the table, never taken by the decisions
+        std::mutex mutex_update;
+
+        /*
+        ---------------
+        PRIVATE METHODS
+        ---------------
+        */
+
+        void check_table(const ThresholdTable& table);
+
+    public:
+        /*
+        ------------
+        CONSTRUCTORS
+        ------------
+        */
+
+        DecisionStage(const ThresholdTable& table);
+
+        /*
+        -------
+        SETTERS
+        -------
+        */
+
+        void set_table(const ThresholdTable& table);
+        void set_threshold(const int& unit,
+                           const int& channel,
+                           const int& group,
+                           const float& corr_thresh);
+
+        /*
+        -------
+        GETTERS
+        -------
+        */
+
+        std::shared_ptr<const ThresholdTable> get_table() const;
+
+        /*
+        --------------
+        PUBLIC METHODS
+        --------------
+        */
+
+        void load_thresholds(const std::string& threshold_file_name);
+        bool decide(const int& unit,
+                    const int& channel,
+                    const int& template_id,
+                    const float& corr_max) const;
+        int decide(const DecisionBatch& batch,
+                   ArrayXb& decisions) const;
+};
+
+#endif // DECISION_H
@@ -0,0 +1,487 @@
+/////////////////////////////
+//** JOURNAL SOURCE FILE ** //
+/////////////////////////////
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "journal.h"
+#include "error_handling.h"
+
+using namespace std;
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+/*
+Returns the name of journal file `idx_file`: `<path_prefix>.<idx_file>.jrnl`.
+*/
+string journal_file_name(const string& path_prefix,
+                         const uint32_t& idx_file){
+    return path_prefix + "." + to_string(idx_file) + ".jrnl";
+}
+
+
+/*
+Reads all records of a journal file.
+
+Arguments
+---------
+`journal_file_name` : Path to the journal file.
+
+`header` : Set to the header of the journal file.
+
+Returns
+-------
+`records` : The records of the journal file.
+*/
+vector<JournalRecord> read_journal_file(const string& journal_file_name,
+                                        JournalFileHeader& header){
+    ifstream journal_file(journal_file_name,ios::binary);
+
+    // Check if the file opened successfully
+    if(!journal_file){
+        string err_msg = "Error opening journal file: " + journal_file_name;
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    // Check the header
+    journal_file.read( (char*)&header,sizeof(header) );
+    if (!journal_file || strncmp(header.magic,"FLTJRNL1",8) != 0 || header.size_record != sizeof(JournalRecord)){
+        string err_msg = "Invalid journal file: " + journal_file_name;
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    vector<JournalRecord> records(header.n_records);
+    journal_file.read( (char*)records.data(),header.n_records*sizeof(JournalRecord) );
+
+    // The file might have been truncated while it was being written
+    records.resize( journal_file.gcount()/sizeof(JournalRecord) );
+
+    return records;
+}
+
+
+/*
+---------------------------
+JOURNALRING: CONSTRUCTORS
+---------------------------
+*/
+
+/*
+Constructor that allocates the ring.
+
+Arguments
+---------
+`capacity` : Minimum number of records that the ring can hold. Rounded up to a power of 2.
+*/
+JournalRing::JournalRing(const size_t& capacity){
+    this->capacity = 1;
+    while (this->capacity < capacity){
+        this->capacity *= 2;
+    }
+
+    this->records.resize(this->capacity);
+    this->head = 0;
+    this->tail = 0;
+    this->n_dropped = 0;
+}
+
+
+/*
+----------------------
+JOURNALRING: METHODS
+----------------------
+*/
+
+/*
+Appends a record to the ring. Only to be called by the producer (worker) thread.
+Never blocks: if the ring is full, the record is dropped.
+
+Arguments
+---------
+`record` : The record to append.
+
+Returns
+-------
+`appended` : False if the record was dropped.
+*/
+bool JournalRing::append(const JournalRecord& record){
+    size_t head = this->head.load(memory_order_relaxed);
+    size_t tail = this->tail.load(memory_order_acquire);
+
+    if (head - tail >= capacity){
+        n_dropped.fetch_add(1,memory_order_relaxed);
+        return false;
+    }
+
+    records[head & (capacity-1)] = record;
+    this->head.store(head+1,memory_order_release);
+
+    return true;
+}
+
+
+/*
+Pops records from the ring. Only to be called by the consumer (flush) thread.
+
+Arguments
+---------
+`records_out` : Array to which the records are copied.
+
+`n_records_max` : Maximum number of records to pop.
+
+Returns
+-------
+`n_records` : Number of records popped.
+*/
+size_t JournalRing::pop(JournalRecord* records_out,
+                        const size_t& n_records_max){
+    size_t tail = this->tail.load(memory_order_relaxed);
+    size_t head = this->head.load(memory_order_acquire);
+
+    size_t n_records = min(head-tail,n_records_max);
+    for (size_t i=0; i<n_records; i++){
+        records_out[i] = records[(tail+i) & (capacity-1)];
+    }
+
+    this->tail.store(tail+n_records,memory_order_release);
+
+    return n_records;
+}
+
+
+/*
+Returns the number of records dropped because the ring was full.
+*/
+uint64_t JournalRing::get_n_dropped(){
+    return n_dropped.load(memory_order_relaxed);
+}
+
+
+/*
+-----------------------
+JOURNAL: CONSTRUCTORS
+-----------------------
+*/
+
+/*
+Constructor that opens the first journal file and starts the background flush thread.
+
+Arguments
+---------
+`path_prefix` : Journal files are named `<path_prefix>.<idx_file>.jrnl`.
+
+`n_records_per_file` : Maximum number of records per file. Must be >= 1. Default is 2^20 (32 MiB).
+
+`max_files` : Number of files kept in the rotation. Must be >= 1. Default is 8.
+
+`capacity_ring` : Capacity of the ring of each writer. Default is 2^16 records.
+
+`flush_interval_ms` : Interval at which the rings are drained when they are empty [ms]. Default is 10.
+*/
+Journal::Journal(const string& path_prefix,
+                 const uint64_t& n_records_per_file,
+                 const int& max_files,
+                 const size_t& capacity_ring,
+                 const int& flush_interval_ms){
+    // Check that a file holds at least one record, otherwise the rotation never ends
+    if (n_records_per_file < 1){
+        string err_msg = "Journal files must hold at least 1 record!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    // Check that the current file is kept in the rotation
+    if (max_files < 1){
+        string err_msg = "Journal must keep at least 1 file!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    this->path_prefix = path_prefix;
+    this->n_records_per_file = n_records_per_file;
+    this->max_files = max_files;
+    this->capacity_ring = capacity_ring;
+    this->flush_interval_ms = flush_interval_ms;
+    this->fd = -1;
+    this->idx_file = 0;
+    this->header = nullptr;
+    this->records_mapped = nullptr;
+    this->n_written = 0;
+    this->failed = false;
+    this->n_discarded = 0;
+
+    open_file();
+
+    this->running = true;
+    this->flush_thread = thread(&Journal::flush_loop,this);
+}
+
+
+/*
+Destructor that flushes all rings and closes the journal. Never throws, see `close`.
+*/
+Journal::~Journal(){
+    close();
+}
+
+
+/*
+------------------
+JOURNAL: METHODS
+------------------
+*/
+
+/*
+Opens journal file `idx_file`, reserves its blocks on disk and memory-maps it.
+Removes the oldest file of the rotation if more than `max_files` files are kept.
+Throws an error if the file cannot be opened or its blocks cannot be reserved (e.g. disk full),
+with no file left open.
+*/
+void Journal::open_file(){
+    string file_name = journal_file_name(path_prefix,idx_file);
+    size_t size_file = sizeof(JournalFileHeader) + n_records_per_file*sizeof(JournalRecord);
+
+    fd = open(file_name.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+    if (fd < 0){
+        string err_msg = "Error opening journal file: " + file_name;
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    // Reserve the blocks of the file, such that a full disk is reported here
+    // instead of raising SIGBUS when the mapped file is written
+    int status = posix_fallocate(fd,0,size_file);
+    if (status != 0){
+        ::close(fd);
+        fd = -1;
+        string err_msg = "Error reserving " + to_string(size_file) + " bytes for journal file: " + file_name + " (" + strerror(status) + ")";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    void* mapped = mmap(nullptr,size_file,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    if (mapped == MAP_FAILED){
+        ::close(fd);
+        fd = -1;
+        string err_msg = "Error memory-mapping journal file: " + file_name;
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    header = (JournalFileHeader*)mapped;
+    records_mapped = (JournalRecord*)( (char*)mapped + sizeof(JournalFileHeader) );
+
+    memcpy(header->magic,"FLTJRNL1",8);
+    header->size_record = sizeof(JournalRecord);
+    header->idx_file = idx_file;
+    header->n_records = 0;
+    header->n_records_max = n_records_per_file;
+
+    // Keep only the last `max_files` files
+    if (idx_file >= (uint32_t)max_files){
+        unlink( journal_file_name(path_prefix,idx_file-max_files).c_str() );
+    }
+
+    return;
+}
+
+
+/*
+Unmaps the current journal file and truncates it to the records that were written.
+The file is closed even if it cannot be truncated, in which case an error is thrown.
+*/
+void Journal::close_file(){
+    if (fd < 0){
+        return;
+    }
+
+    size_t size_file = sizeof(JournalFileHeader) + n_records_per_file*sizeof(JournalRecord);
+    size_t size_used = sizeof(JournalFileHeader) + header->n_records*sizeof(JournalRecord);
+
+    munmap(header,size_file);
+    int status = ftruncate(fd,size_used);
+    ::close(fd);
+
+    fd = -1;
+    header = nullptr;
+    records_mapped = nullptr;
+
+    if (status != 0){
+        string err_msg = "Error truncating journal file: " + journal_file_name(path_prefix,idx_file);
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    return;
+}
+
+
+/*
+Drains all rings into the memory-mapped file, and rotates the file when it is full.
+
+Returns
+-------
+`n_drained` : Number of records drained.
+*/
+size_t Journal::drain(){
+    lock_guard<mutex> lock(rings_mutex);
+
+    size_t n_drained = 0;
+    for (unique_ptr<JournalRing>& ring : rings){
+        while (true){
+            // Rotate if the file is full
+            if (header->n_records == n_records_per_file){
+                close_file();
+                idx_file++;
+                open_file();
+            }
+
+            size_t n_popped = ring->pop(records_mapped + header->n_records,
+                                        n_records_per_file - header->n_records);
+            if (n_popped == 0){
+                break;
+            }
+
+            // Counted at once, such that the count is right if the next rotation fails
+            header->n_records += n_popped;
+            n_drained += n_popped;
+            n_written += n_popped;
+        }
+    }
+
+    return n_drained;
+}
+
+
+/*
+Discards the records left in all rings after an I/O error, and counts them as dropped.
+*/
+void Journal::discard(){
+    lock_guard<mutex> lock(rings_mutex);
+
+    JournalRecord records_discarded[256];
+    for (unique_ptr<JournalRing>& ring : rings){
+        size_t n_popped;
+        while ( (n_popped = ring->pop(records_discarded,256)) > 0 ){
+            n_discarded += n_popped;
+        }
+    }
+
+    return;
+}
+
+
+/*
+Records an I/O error that stopped the journal. Only the first error is kept.
+*/
+void Journal::set_error(const string& error_msg){
+    lock_guard<mutex> lock(error_mutex);
+
+    if (!failed){
+        this->error_msg = error_msg;
+        failed = true;
+    }
+
+    return;
+}
+
+
+/*
+Loop of the background flush thread.
+The thread stops at the first I/O error, which is recorded instead of thrown: nothing would catch it here.
+*/
+void Journal::flush_loop(){
+    while (running.load()){
+        try{
+            if (drain() == 0){
+                this_thread::sleep_for( chrono::milliseconds(flush_interval_ms) );
+            }
+        }
+        catch (const exception& err){
+            set_error( err.what() );
+            return;
+        }
+    }
+
+    return;
+}
+
+
+/*
+Registers a writer (worker thread) and returns its ring.
+The ring remains owned by the journal, and must only be appended to by a single thread.
+*/
+JournalRing* Journal::register_writer(){
+    lock_guard<mutex> lock(rings_mutex);
+
+    rings.push_back( make_unique<JournalRing>(capacity_ring) );
+
+    return rings.back().get();
+}
+
+
+/*
+Stops the background flush thread, drains all rings and closes the current file.
+Writers must no longer append after the journal was closed.
+Never throws: I/O errors are recorded, see `get_error`.
+
+Returns
+-------
+`ok` : False if an I/O error occurred since the journal was opened.
+*/
+bool Journal::close(){
+    if (flush_thread.joinable()){
+        running = false;
+        flush_thread.join();
+
+        try{
+            if (!failed){
+                drain();
+            }
+            close_file();
+        }
+        catch (const exception& err){
+            set_error( err.what() );
+        }
+
+        if (failed){
+            discard();
+        }
+    }
+
+    return !failed;
+}
+
+
+/*
+Returns the number of records written to the journal files.
+*/
+uint64_t Journal::get_n_written(){
+    return n_written.load();
+}
+
+
+/*
+Returns the message of the I/O error that stopped the journal, empty if there was none.
+*/
+string Journal::get_error(){
+    lock_guard<mutex> lock(error_mutex);
+
+    return this->error_msg;
+}
+
+
+/*
+Returns the number of records dropped by all writers because their ring was full,
+and the records discarded after an I/O error.
+*/
+uint64_t Journal::get_n_dropped(){
+    lock_guard<mutex> lock(rings_mutex);
+
+    uint64_t n_dropped = n_discarded;
+    for (unique_ptr<JournalRing>& ring : rings){
+        n_dropped += ring->get_n_dropped();
+    }
+
+    return n_dropped;
+}
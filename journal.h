@@ -0,0 +1,222 @@
+/*
+/////////////////////////////
+//** JOURNAL HEADER FILE ** //
+/////////////////////////////
+
+This file defines the result journal of the Template FLT-1.
+Every trigger decision is recorded as a fixed-size binary record.
+
+Each worker thread appends its records to its own lock-free single-producer/single-consumer ring.
+Appending never blocks: if the ring is full, the record is dropped and counted.
+A background thread drains all rings and copies the records into a memory-mapped journal file.
+When a file is full, the journal rotates to a new file, and only the last `max_files` files are kept.
+The blocks of each journal file are reserved on disk when it is opened, such that a full disk is an I/O error
+instead of a SIGBUS on a write to the mapped file.
+An I/O error of the background thread (e.g. disk full) stops the journal: the error is recorded and reported
+by `close` and `get_error`, and the records that were not written are counted as dropped.
+Trigger processing is never interrupted.
+
+Journal file layout:
+- JournalFileHeader (32 bytes)
+- `n_records` JournalRecords (32 bytes each)
+Use `tools/journal_reader.cpp` to dump or summarize journal files.
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+-------
+STRUCTS
+-------
+*/
+
+// One trigger decision for one channel of one detector unit
+struct JournalRecord{
+    // Event ID
+    uint64_t event_id;
+    // Detector unit ID
+    uint32_t unit;
+    // Channel (polarization) of the detector unit
+    uint16_t channel;
+    // Trigger decision of the Template FLT-1
+    uint8_t decision;
+    // Index of the best desampling (phase) of the best-fit template
+    uint8_t idx_template_desampled_best;
+    // ID of best-fit template
+    int32_t template_id_best;
+    // Best-fit time of the pulse peak
+    int32_t t_peak_best;
+    // Maximum correlation yielding the best-fit template
+    float corr_max_best;
+    // Latency from FLT-0 trigger to decision [ns]
+    uint32_t latency_ns;
+};
+static_assert(sizeof(JournalRecord) == 32, "JournalRecord must be 32 bytes");
+
+// Header at the start of each journal file
+struct JournalFileHeader{
+    // Magic bytes "FLTJRNL1"
+    char magic[8];
+    // Size of one record [bytes]
+    uint32_t size_record;
+    // Index of the file in the rotation
+    uint32_t idx_file;
+    // Number of records written in the file
+    uint64_t n_records;
+    // Maximum number of records of the file
+    uint64_t n_records_max;
+};
+static_assert(sizeof(JournalFileHeader) == 32, "JournalFileHeader must be 32 bytes");
+
+/*
+-------
+CLASSES
+-------
+*/
+
+// Lock-free single-producer/single-consumer ring of journal records
+class JournalRing{
+    private:
+        /*
+        ------------------
+        PRIVATE ATTRIBUTES
+        ------------------
+        */
+
+        // Capacity of the ring, power of 2
+        size_t capacity;
+        // Storage of the ring
+        std::vector<JournalRecord> records;
+
+        // Position of the next record to write, only modified by the producer
+        alignas(64) std::atomic<size_t> head;
+        // Position of the next record to read, only modified by the consumer
+        alignas(64) std::atomic<size_t> tail;
+        // Number of records dropped because the ring was full
+        alignas(64) std::atomic<uint64_t> n_dropped;
+
+    public:
+        /*
+        ------------
+        CONSTRUCTORS
+        ------------
+        */
+
+        JournalRing(const size_t& capacity);
+
+        /*
+        --------------
+        PUBLIC METHODS
+        --------------
+        */
+
+        bool append(const JournalRecord& record);
+        size_t pop(JournalRecord* records_out,
+                   const size_t& n_records_max);
+        uint64_t get_n_dropped();
+};
+
+class Journal{
+    private:
+        /*
+        ------------------
+        PRIVATE ATTRIBUTES
+        ------------------
+        */
+
+        // Journal files are named `<path_prefix>.<idx_file>.jrnl`
+        std::string path_prefix;
+        // Maximum number of records per file
+        uint64_t n_records_per_file;
+        // Number of files kept in the rotation
+        int max_files;
+        // Capacity of the ring of each writer
+        size_t capacity_ring;
+        // Interval at which the background thread drains the rings when they are empty [ms]
+        int flush_interval_ms;
+
+        // Rings of all writers
+        std::deque< std::unique_ptr<JournalRing> > rings;
+        std::mutex rings_mutex;
+
+        // Current memory-mapped file
+        int fd;
+        uint32_t idx_file;
+        JournalFileHeader* header;
+        JournalRecord* records_mapped;
+
+        // Background flush thread
+        std::thread flush_thread;
+        std::atomic<bool> running;
+        std::atomic<uint64_t> n_written;
+
+        // Set when an I/O error stopped the journal, with its message
+        // Records left in the rings after the error are discarded when the journal is closed
+        std::atomic<bool> failed;
+        std::atomic<uint64_t> n_discarded;
+        std::string error_msg;
+        std::mutex error_mutex;
+
+        /*
+        ---------------
+        PRIVATE METHODS
+        ---------------
+        */
+
+        void open_file();
+        void close_file();
+        void flush_loop();
+        size_t drain();
+        void discard();
+        void set_error(const std::string& error_msg);
+
+    public:
+        /*
+        ------------
+        CONSTRUCTORS
+        ------------
+        */
+
+        Journal(const std::string& path_prefix,
+                const uint64_t& n_records_per_file = 1<<20,
+                const int& max_files = 8,
+                const size_t& capacity_ring = 1<<16,
+                const int& flush_interval_ms = 10);
+        ~Journal();
+
+        /*
+        --------------
+        PUBLIC METHODS
+        --------------
+        */
+
+        JournalRing* register_writer();
+        bool close();
+        uint64_t get_n_written();
+        uint64_t get_n_dropped();
+        std::string get_error();
+};
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+std::string journal_file_name(const std::string& path_prefix,
+                              const uint32_t& idx_file);
+
+std::vector<JournalRecord> read_journal_file(const std::string& journal_file_name,
+                                             JournalFileHeader& header);
+
+#endif // JOURNAL_H
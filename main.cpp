@@ -18,15 +18,13 @@ int main() {
 
     // Loop over all desired iterations
     // You can time the `main` executable in your preferred shell
-    int t_max_x, t_max_y, trace_max_x, trace_max_y;
+    // t_max = -1: the trace maximum is searched in the fused preprocessing pass
     for (int i=0; i<N_ITER; i++){
         // Evaluate X
-        trace_max_x = test_trace[0].maxCoeff(&t_max_x);
-        flt_x.template_fit(test_trace[0],t_max_x);
+        flt_x.template_fit(test_trace[0],-1);
 
         // Evaluate Y
-        trace_max_y = test_trace[1].maxCoeff(&t_max_y);
-        flt_y.template_fit(test_trace[1],t_max_y);
+        flt_y.template_fit(test_trace[1],-1);
     }
 
     // Print the last evaluation of the template FLT
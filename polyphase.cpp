@@ -0,0 +1,145 @@
+///////////////////////////////
+//** POLYPHASE SOURCE FILE ** //
+///////////////////////////////
+
+#include <cmath>
+#include "polyphase.h"
+#include "error_handling.h"
+
+using namespace std;
+
+/*
+-----------------------------------
+POLYPHASEFILTERBANK: CONSTRUCTORS
+-----------------------------------
+*/
+
+/*
+Constructor that creates an "empty" PolyphaseFilterBank object.
+*/
+PolyphaseFilterBank::PolyphaseFilterBank(){
+    this->desampling_factor = 0;
+    this->n_phases = 0;
+    this->n_taps = 0;
+}
+
+
+/*
+Constructor that computes the interpolation filters of all phases.
+The filters are Blackman-windowed sinc filters, normalized to unit DC gain.
+
+Arguments
+---------
+`desampling_factor` : Simulation sampling rate / ADC sampling rate.
+
+`n_phases` : Number of phases per desampled template. Must be >= 1.
+
+`n_taps` : Number of taps of the interpolation filters. Must be even and >= 2. Default is 16.
+*/
+PolyphaseFilterBank::PolyphaseFilterBank(const int& desampling_factor,
+                                         const int& n_phases,
+                                         const int& n_taps){
+    // Check the arguments
+    if (desampling_factor < 1 || n_phases < 1){
+        string err_msg = "Desampling factor and number of phases must be >= 1!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    if (n_taps < 2 || n_taps % 2 != 0){
+        string err_msg = "Number of taps " + to_string(n_taps) + " must be even and >= 2!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    this->desampling_factor = desampling_factor;
+    this->n_phases = n_phases;
+    this->n_taps = n_taps;
+
+    filters.resize(n_taps,n_phases);
+    offsets.resize(n_phases);
+
+    for (int p=0; p<n_phases; p++){
+        double delay = get_delay(p);
+        offsets(p) = floor(delay);
+        double frac = delay - offsets(p);
+
+        // Tap k interpolates sample offsets(p) + k - n_taps/2 + 1
+        for (int k=0; k<n_taps; k++){
+            double t = k - n_taps/2 + 1 - frac;
+            double sinc = abs(t) < 1e-9 ? 1 : sin(M_PI*t)/(M_PI*t);
+            double window = 0.42 + 0.5*cos(2*M_PI*t/n_taps) + 0.08*cos(4*M_PI*t/n_taps);
+            filters(k,p) = sinc*window;
+        }
+        filters.col(p) /= filters.col(p).sum();
+    }
+}
+
+
+/*
+------------------------------
+POLYPHASEFILTERBANK: GETTERS
+------------------------------
+*/
+
+/*
+Getter for `n_phases`.
+*/
+int PolyphaseFilterBank::get_n_phases() const{
+    return this->n_phases;
+}
+
+/*
+Getter for `n_taps`.
+*/
+int PolyphaseFilterBank::get_n_taps() const{
+    return this->n_taps;
+}
+
+/*
+Returns the delay of a phase [simulation samples] = phase*desampling_factor/n_phases.
+*/
+float PolyphaseFilterBank::get_delay(const int& phase) const{
+    return (float)phase*desampling_factor/n_phases;
+}
+
+
+/*
+------------------------------
+POLYPHASEFILTERBANK: METHODS
+------------------------------
+*/
+
+/*
+Generates a phase of a desampled template.
+Samples of the template outside of its range are taken as 0.
+
+Arguments
+---------
+`templ` : Template at the simulation sampling rate.
+
+`phase` : Phase to generate. Must be between [0,n_phases).
+
+`templ_desampled` : Set to the desampled template. Its size sets the number of generated samples.
+*/
+void PolyphaseFilterBank::generate(const Eigen::ArrayXf& templ,
+                                   const int& phase,
+                                   Eigen::Ref<Eigen::VectorXf> templ_desampled) const{
+    int size_templ = templ.size();
+    int start_filter = offsets(phase) - n_taps/2 + 1;
+
+    for (int n=0; n<templ_desampled.size(); n++){
+        int start = n*desampling_factor + start_filter;
+
+        // Fast path if the filter falls completely inside of the template
+        if (start >= 0 && start + n_taps <= size_templ){
+            templ_desampled(n) = templ.segment(start,n_taps).matrix().dot( filters.col(phase) );
+        }
+        else{
+            float value = 0;
+            for (int k=max(0,-start); k<n_taps && start+k<size_templ; k++){
+                value += templ(start+k)*filters(k,phase);
+            }
+            templ_desampled(n) = value;
+        }
+    }
+
+    return;
+}
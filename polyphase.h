@@ -0,0 +1,78 @@
+/*
+///////////////////////////////
+//** POLYPHASE HEADER FILE ** //
+///////////////////////////////
+
+This file defines the on-the-fly generation of desampled templates with a polyphase interpolation filter bank.
+
+`TemplateFLT::desample_templates` stores `desampling_factor` desampled copies of each template,
+with phases limited to the simulation sampling grid. Instead, the polyphase filter bank generates
+desampled templates at any of `n_phases` fractional delays from the template at the simulation sampling rate.
+Phase p of a template samples it at the (simulation) samples n*desampling_factor + p*desampling_factor/n_phases,
+interpolated with a windowed-sinc filter of `n_taps` taps.
+For n_phases = desampling_factor, all delays fall on the simulation grid and the phases are exactly
+the desampled templates of `desample_templates`.
+
+The phases are not stored: the phases of each template are generated again at every fit.
+*/
+
+#ifndef POLYPHASE_H
+#define POLYPHASE_H
+
+#include <eigen3/Eigen/Dense>
+
+class PolyphaseFilterBank{
+    private:
+        /*
+        ------------------
+        PRIVATE ATTRIBUTES
+        ------------------
+        */
+
+        // Desampling factor = simulation sampling rate / ADC sampling rate
+        int desampling_factor;
+        // Number of phases (fractional delays) per desampled template
+        int n_phases;
+        // Number of taps of the interpolation filter of each phase
+        int n_taps;
+
+        // Interpolation filters, column p is the filter of phase p
+        Eigen::MatrixXf filters;
+        // Integer part of the delay of each phase [simulation samples]
+        Eigen::ArrayXi offsets;
+
+    public:
+        /*
+        ------------
+        CONSTRUCTORS
+        ------------
+        */
+
+        PolyphaseFilterBank();
+
+        PolyphaseFilterBank(const int& desampling_factor,
+                            const int& n_phases,
+                            const int& n_taps = 16);
+
+        /*
+        -------
+        GETTERS
+        -------
+        */
+
+        int get_n_phases() const;
+        int get_n_taps() const;
+        float get_delay(const int& phase) const;
+
+        /*
+        --------------
+        PUBLIC METHODS
+        --------------
+        */
+
+        void generate(const Eigen::ArrayXf& templ,
+                      const int& phase,
+                      Eigen::Ref<Eigen::VectorXf> templ_desampled) const;
+};
+
+#endif // POLYPHASE_H
@@ -0,0 +1,332 @@
+////////////////////////////////
+//** PRE-FILTER SOURCE FILE ** //
+////////////////////////////////
+
+#include <cmath>
+#include "prefilter.h"
+#include "utils.h"
+#include "error_handling.h"
+
+using namespace std;
+
+// Margin subtracted from the derived cut of the subspace correlation, for the floating-point rounding of the correlations
+const float CORR_SUBSPACE_MARGIN = 1e-4;
+
+/*
+------------
+CONSTRUCTORS
+------------
+*/
+
+/*
+Constructor that creates a disabled PreFilter object.
+*/
+PreFilter::PreFilter(){
+    this->config = PreFilterConfig();
+    this->corr_components_min = 0;
+    this->min_corr_subspace = 0;
+}
+
+
+/*
+Constructor that computes the mean template of a template library.
+
+Arguments
+---------
+`templates_desampled` : Desampled templates of size N_templates*desampling_factor*size_template_desampled,
+                        see `TemplateFLT::desample_templates`.
+
+`config` : Configuration of the pre-filter cuts.
+
+`corr_thresh` : Correlation threshold of the template fit, from which the subspace cut is derived. Default is 0.
+*/
+PreFilter::PreFilter(const vector< vector< Eigen::ArrayXf > >& templates_desampled,
+                     const PreFilterConfig& config,
+                     const float& corr_thresh){
+    this->config = config;
+
+    // Mean of all desampled templates
+    // All desampled templates are truncated to the size of the shortest one
+    int size_template_mean = templates_desampled[0][0].size();
+    for (const vector< Eigen::ArrayXf >& desampled_template_set : templates_desampled){
+        for (const Eigen::ArrayXf& desampled_template : desampled_template_set){
+            size_template_mean = min(size_template_mean,(int)desampled_template.size());
+        }
+    }
+
+    int n_templates = 0;
+    this->template_mean = Eigen::ArrayXf::Zero(size_template_mean);
+    for (const vector< Eigen::ArrayXf >& desampled_template_set : templates_desampled){
+        for (const Eigen::ArrayXf& desampled_template : desampled_template_set){
+            this->template_mean += desampled_template.head(size_template_mean);
+            n_templates += 1;
+        }
+    }
+    this->template_mean /= n_templates;
+
+    // Desampled templates normalized to unit norm, column-wise
+    bool same_size = true;
+    Eigen::MatrixXf templates_normalized(size_template_mean,n_templates);
+    int c = 0;
+    for (const vector< Eigen::ArrayXf >& desampled_template_set : templates_desampled){
+        for (const Eigen::ArrayXf& desampled_template : desampled_template_set){
+            same_size = same_size && desampled_template.size() == size_template_mean;
+            templates_normalized.col(c) = desampled_template.head(size_template_mean).matrix().normalized();
+            c++;
+        }
+    }
+
+    // Principal components of the subspace cut
+    // The bound only holds if the windows of the fit have the size of the components
+    int n_components = min( {config.n_components,size_template_mean,n_templates} );
+    this->components.resize(size_template_mean,0);
+    this->corr_components_min = 0;
+    if (n_components > 0 && same_size){
+        Eigen::JacobiSVD<Eigen::MatrixXf> svd(templates_normalized,Eigen::ComputeThinU);
+        this->components = svd.matrixU().leftCols(n_components);
+        this->corr_components_min = ( this->components.transpose() * templates_normalized ).colwise().norm().minCoeff();
+    }
+
+    set_corr_thresh(corr_thresh);
+}
+
+
+/*
+-------
+SETTERS
+-------
+*/
+
+/*
+Derives the minimum correlation of the subspace cut from the correlation threshold of the template fit.
+This is the largest cut that never rejects a trace with `corr_max_best` > `corr_thresh`, see `prefilter.h`,
+minus a margin for the floating-point rounding. The cut is disabled if the bound is not positive.
+
+Arguments
+---------
+`corr_thresh` : Correlation threshold of the template fit, between [0,1].
+*/
+void PreFilter::set_corr_thresh(const float& corr_thresh){
+    this->min_corr_subspace = 0;
+
+    if (components.cols() > 0){
+        float angle = acos( min(corr_thresh,1.f) ) + acos( min(corr_components_min,1.f) );
+        if (angle < M_PI/2){
+            this->min_corr_subspace = max(cos(angle) - CORR_SUBSPACE_MARGIN,0.f);
+        }
+    }
+
+    return;
+}
+
+
+/*
+-------
+GETTERS
+-------
+*/
+
+/*
+Getter for `config`.
+*/
+PreFilterConfig PreFilter::get_config() const{
+    return this->config;
+}
+
+/*
+Getter for `template_mean`.
+*/
+Eigen::ArrayXf PreFilter::get_template_mean(){
+    return this->template_mean;
+}
+
+/*
+Getter for the minimum correlation of the subspace cut, 0 if the cut is disabled.
+*/
+float PreFilter::get_min_corr_subspace() const{
+    return this->min_corr_subspace;
+}
+
+
+/*
+-------
+METHODS
+-------
+*/
+
+/*
+Computes the ratio of |peak| and the RMS of the segment.
+
+Arguments
+---------
+`segment` : Trace segment around the trace maximum.
+
+`t_max_segment` : Position of the trace maximum in `segment`.
+*/
+float PreFilter::peak_to_rms(const Eigen::ArrayXf& segment,
+                             const int& t_max_segment) const{
+    return abs( segment(t_max_segment) ) / rms(segment);
+}
+
+
+/*
+Computes the pulse width as the number of contiguous samples around the trace maximum with |sample| >= |peak|/2.
+
+Arguments
+---------
+`segment` : Trace segment around the trace maximum.
+
+`t_max_segment` : Position of the trace maximum in `segment`.
+*/
+int PreFilter::pulse_width(const Eigen::ArrayXf& segment,
+                           const int& t_max_segment) const{
+    float half_peak = abs( segment(t_max_segment) ) / 2;
+
+    int start = t_max_segment, end = t_max_segment;
+    while (start > 0 && abs( segment(start-1) ) >= half_peak){
+        start--;
+    }
+    while (end < segment.size()-1 && abs( segment(end+1) ) >= half_peak){
+        end++;
+    }
+
+    return end - start + 1;
+}
+
+
+/*
+Computes the number of sign changes of the significant samples of the segment.
+A sample is significant if |sample| >= `config.sign_frac`*|peak|.
+Air-shower pulses have few lobes, narrow-band RFI has many.
+
+Arguments
+---------
+`segment` : Trace segment around the trace maximum.
+
+`t_max_segment` : Position of the trace maximum in `segment`.
+*/
+int PreFilter::sign_changes(const Eigen::ArrayXf& segment,
+                            const int& t_max_segment) const{
+    float level = config.sign_frac * abs( segment(t_max_segment) );
+
+    int n_sign_changes = 0;
+    int sign_previous = 0;
+    for (int i=0; i<segment.size(); i++){
+        if (abs( segment(i) ) < level){
+            continue;
+        }
+        int sign = segment(i) > 0 ? 1 : -1;
+        if (sign_previous != 0 && sign != sign_previous){
+            n_sign_changes++;
+        }
+        sign_previous = sign;
+    }
+
+    return n_sign_changes;
+}
+
+
+/*
+Computes the maximum abs(correlation) of the segment with the mean template, normalized between [0,1].
+This costs one correlation instead of N_templates*desampling_factor correlations for the full fit.
+Returns 1 if the segment is shorter than the mean template, such that the trace is not rejected.
+
+Arguments
+---------
+`segment` : Trace segment around the trace maximum.
+*/
+float PreFilter::corr_mean(const Eigen::ArrayXf& segment) const{
+    if (segment.size() < template_mean.size()){
+        return 1;
+    }
+
+    return correlate(segment,template_mean,true).abs().maxCoeff();
+}
+
+
+/*
+Computes the maximum correlation of the windows of the segment with the subspace of the principal components,
+i.e. the norm of the projection of each window on the subspace divided by the norm of the window.
+This costs `n_components` correlations, computed in a single matrix product.
+Returns 1 if the segment is shorter than the components, such that the trace is not rejected.
+
+Arguments
+---------
+`segment` : Trace segment around the trace maximum.
+*/
+float PreFilter::corr_subspace(const Eigen::ArrayXf& segment) const{
+    int size_templ = components.rows();
+    if (segment.size() < size_templ){
+        return 1;
+    }
+
+    // All windows of the segment and their norms
+    Eigen::ArrayXf rms_windows;
+    SegmentWindows windows = get_windows(segment,size_templ,rms_windows);
+    Eigen::ArrayXf norms_windows = rms_windows * sqrt( (float)size_templ );
+
+    Eigen::ArrayXf norms_projection = ( windows.transpose() * components ).rowwise().norm().array();
+
+    // Windows of zero norm have no correlation
+    return ( norms_windows > 0 ).select(norms_projection / norms_windows,0.f).maxCoeff();
+}
+
+
+/*
+Applies all enabled cuts of the pre-filter to a trace segment, and updates the counters.
+The cheapest cuts are evaluated first.
+Does not modify the pre-filter, such that one pre-filter can be shared by several threads,
+each with its own counters.
+
+Arguments
+---------
+`segment` : Trace segment around the trace maximum.
+
+`t_max_segment` : Position of the trace maximum in `segment`, within [0,segment.size()).
+
+`stats` : Counters to update.
+
+Returns
+-------
+`accepted` : True if the trace passes all enabled cuts.
+*/
+bool PreFilter::accept(const Eigen::ArrayXf& segment,
+                       const int& t_max_segment,
+                       PreFilterStats& stats) const{
+    // Check that the trace maximum lies within the segment
+    if (t_max_segment < 0 || t_max_segment >= segment.size()){
+        string err_msg = "Invalid argument: t_max_segment=" + to_string(t_max_segment) + " must be within [0," + to_string(segment.size()) + ")";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    stats.n_evaluated++;
+
+    bool accepted = true;
+
+    if (config.min_peak_to_rms > 0 && peak_to_rms(segment,t_max_segment) < config.min_peak_to_rms){
+        stats.n_rejected_peak_to_rms++;
+        accepted = false;
+    }
+    else if (config.max_pulse_width > 0 && pulse_width(segment,t_max_segment) > config.max_pulse_width){
+        stats.n_rejected_pulse_width++;
+        accepted = false;
+    }
+    else if (config.max_sign_changes > 0 && sign_changes(segment,t_max_segment) > config.max_sign_changes){
+        stats.n_rejected_sign_changes++;
+        accepted = false;
+    }
+    else if (config.min_corr_mean > 0 && corr_mean(segment) < config.min_corr_mean){
+        stats.n_rejected_corr_mean++;
+        accepted = false;
+    }
+    else if (min_corr_subspace > 0 && corr_subspace(segment) < min_corr_subspace){
+        stats.n_rejected_corr_subspace++;
+        accepted = false;
+    }
+
+    if (!accepted){
+        stats.n_rejected++;
+    }
+
+    return accepted;
+}
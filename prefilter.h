@@ -0,0 +1,159 @@
+/*
+////////////////////////////////
+//** PRE-FILTER HEADER FILE ** //
+////////////////////////////////
+
+This file defines the pre-filter stage of the Template FLT-1.
+The pre-filter runs in front of the template fit, and computes cheap features
+on the trace segment around the trace maximum:
+- peak-to-RMS ratio of the segment,
+- pulse width = number of contiguous samples around the maximum above half of the peak,
+- sign pattern = number of sign changes of the significant samples of the segment,
+- maximum correlation with the mean template of the template library,
+- maximum correlation with the subspace spanned by the first `n_components` principal components
+  of the desampled templates.
+Traces that fail any of the enabled cuts are rejected without the (expensive) full template fit.
+
+The cut on the subspace correlation is derived from the correlation threshold of the template fit.
+If a window of the segment has abs(correlation) > corr_thresh with a desampled template, and each desampled
+template has a correlation >= c_min with its projection on the subspace, the angles add up, such that the window
+has a correlation >= cos(acos(corr_thresh) + acos(c_min)) with the subspace. With this cut, the pre-filter never
+vetoes a trace that the full fit would accept, at the cost of `n_components` correlations instead of
+N_templates*desampling_factor. Phases of the polyphase engine that are not desampled templates
+(more phases than the desampling factor) are not covered by this bound.
+
+The other cuts are heuristic and do not depend on the correlation threshold, they are disabled by default.
+In verification mode, the full template fit is also run for rejected traces,
+and the number of traces vetoed by the pre-filter that would have been accepted by the full fit is counted.
+This allows to prove on data that a pre-filter configuration never vetoes a trace the full fit would accept,
+see `tools/differential_test.cpp`.
+*/
+
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <vector>
+#include <eigen3/Eigen/Dense>
+
+/*
+-------
+STRUCTS
+-------
+*/
+
+// Configuration of the pre-filter
+// A cut set to 0 is disabled
+// The heuristic cuts do not depend on the correlation threshold, and must be validated in verification mode
+struct PreFilterConfig{
+    // Run the pre-filter in front of the template fit
+    bool enabled = false;
+    // Also run the full template fit for rejected traces, and count false vetoes
+    bool verify = false;
+
+    // Minimum |peak| / RMS of the segment
+    float min_peak_to_rms = 0;
+    // Maximum number of contiguous samples around the maximum with |sample| >= |peak|/2
+    int max_pulse_width = 0;
+    // Maximum number of sign changes of the samples with |sample| >= sign_frac*|peak|
+    int max_sign_changes = 0;
+    // Fraction of |peak| above which a sample is significant for the sign pattern
+    float sign_frac = 0.25;
+    // Minimum maximum abs(correlation) with the mean template, between [0,1]
+    float min_corr_mean = 0;
+    // Number of principal components of the subspace cut, whose minimum correlation is derived from
+    // the correlation threshold of the template fit, see `PreFilter::set_corr_thresh`
+    int n_components = 0;
+};
+
+// Counters of the pre-filter
+struct PreFilterStats{
+    // Number of traces evaluated by the pre-filter
+    long n_evaluated = 0;
+    // Number of traces rejected by the pre-filter
+    long n_rejected = 0;
+    // Number of traces rejected by each cut
+    // A trace is counted for the first cut it fails
+    long n_rejected_peak_to_rms = 0;
+    long n_rejected_pulse_width = 0;
+    long n_rejected_sign_changes = 0;
+    long n_rejected_corr_mean = 0;
+    long n_rejected_corr_subspace = 0;
+    // Number of rejected traces for which the full template fit was run in verification mode
+    long n_verified = 0;
+    // Number of rejected traces that the full template fit would have accepted
+    long n_false_vetoes = 0;
+};
+
+class PreFilter{
+    private:
+        /*
+        ------------------
+        PRIVATE ATTRIBUTES
+        ------------------
+        */
+
+        // Configuration of the cuts
+        PreFilterConfig config;
+
+        // Mean of all desampled templates
+        Eigen::ArrayXf template_mean;
+
+        // Orthonormal basis of the subspace cut (columns), first principal components of the desampled templates
+        Eigen::MatrixXf components;
+        // Minimum correlation of a desampled template with its projection on the subspace, 0 if not all
+        // desampled templates have the size of the mean template
+        float corr_components_min;
+        // Minimum correlation with the subspace, derived from the correlation threshold
+        float min_corr_subspace;
+
+    public:
+        /*
+        ------------
+        CONSTRUCTORS
+        ------------
+        */
+
+        PreFilter();
+
+        PreFilter(const std::vector< std::vector< Eigen::ArrayXf > >& templates_desampled,
+                  const PreFilterConfig& config,
+                  const float& corr_thresh = 0);
+
+        /*
+        -------
+        SETTERS
+        -------
+        */
+
+        void set_corr_thresh(const float& corr_thresh);
+
+        /*
+        -------
+        GETTERS
+        -------
+        */
+
+        PreFilterConfig get_config() const;
+        Eigen::ArrayXf get_template_mean();
+        float get_min_corr_subspace() const;
+
+        /*
+        --------------
+        PUBLIC METHODS
+        --------------
+        */
+
+        float peak_to_rms(const Eigen::ArrayXf& segment,
+                          const int& t_max_segment) const;
+        int pulse_width(const Eigen::ArrayXf& segment,
+                        const int& t_max_segment) const;
+        int sign_changes(const Eigen::ArrayXf& segment,
+                         const int& t_max_segment) const;
+        float corr_mean(const Eigen::ArrayXf& segment) const;
+        float corr_subspace(const Eigen::ArrayXf& segment) const;
+        bool accept(const Eigen::ArrayXf& segment,
+                    const int& t_max_segment,
+                    PreFilterStats& stats) const;
+};
+
+#endif // PREFILTER_H
@@ -0,0 +1,182 @@
+///////////////////////////////////
+//** PREPROCESSING SOURCE FILE ** //
+///////////////////////////////////
+
+#include <climits>
+#include "preprocessing.h"
+#include "error_handling.h"
+
+using namespace std;
+
+// Number of samples processed at once in the vectorized pass
+const int SIZE_BLOCK = 16;
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+/*
+Scans a trace once to estimate the pedestal, search the trace maximum and count the saturated samples.
+The trace is processed in blocks of SIZE_BLOCK samples with vectorized reductions.
+Only blocks that straddle the edge of the baseline or the FLT-0 window are processed sample by sample.
+The first sample that reaches the maximum is kept, as with `Eigen::ArrayXi::maxCoeff`.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`config` : Configuration of the preprocessing.
+
+`window_flt0` : FLT-0 window {start,end} of the event in which the trace maximum is searched, end = 0 means
+                the end of the trace. If start < 0, the default window of `config` is used.
+
+`search_peak` : Option to search the trace maximum within the FLT-0 window. If false, `preprocessed.t_max` is kept.
+
+`preprocessed` : Set to the pedestal, trace maximum and number of saturated samples.
+*/
+void scan_trace(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                const PreprocessConfig& config,
+                const Eigen::Array2i& window_flt0,
+                const bool& search_peak,
+                PreprocessedTrace& preprocessed){
+    int size_trace = trace.size();
+    int size_baseline = min(config.size_baseline,size_trace);
+
+    // FLT-0 window of the event, or the default window
+    bool window_default = window_flt0(0) < 0;
+    int window_start = window_default ? max(config.window_start,0) : window_flt0(0);
+    int window_end = window_default ? config.window_end : window_flt0(1);
+    window_end = window_end > 0 ? min(window_end,size_trace) : size_trace;
+    int saturation_level = config.saturation_level;
+
+    // Check that the FLT-0 window is not empty
+    if (search_peak && window_start >= window_end){
+        string err_msg = "FLT-0 window [" + to_string(window_start) + "," + to_string(window_end) + ") is empty!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    // Only scan as far as needed
+    int size_scan = max(size_baseline,search_peak ? window_end : 0);
+    if (saturation_level > 0){
+        size_scan = size_trace;
+    }
+
+    long baseline_sum = 0;
+    int n_saturated = 0;
+    int value_max = INT_MIN, value_min = INT_MAX;
+    int t_value_max = window_start, t_value_min = window_start;
+
+    // Processes one sample
+    auto scan_sample = [&](const int& i){
+        int value = trace(i);
+        if (i < size_baseline){
+            baseline_sum += value;
+        }
+        if (saturation_level > 0 && abs(value) >= saturation_level){
+            n_saturated++;
+        }
+        if (search_peak && i >= window_start && i < window_end){
+            if (value > value_max){
+                value_max = value;
+                t_value_max = i;
+            }
+            if (value < value_min){
+                value_min = value;
+                t_value_min = i;
+            }
+        }
+    };
+
+    int i = 0;
+    for (; i+SIZE_BLOCK<=size_scan; i+=SIZE_BLOCK){
+        bool in_baseline = i+SIZE_BLOCK <= size_baseline;
+        bool in_window = search_peak && i >= window_start && i+SIZE_BLOCK <= window_end;
+        bool straddles_baseline = i < size_baseline && !in_baseline;
+        bool straddles_window = search_peak && !in_window && i < window_end && i+SIZE_BLOCK > window_start;
+
+        if (straddles_baseline || straddles_window){
+            for (int k=i; k<i+SIZE_BLOCK; k++){
+                scan_sample(k);
+            }
+            continue;
+        }
+
+        Eigen::Array<int,SIZE_BLOCK,1> block = trace.segment<SIZE_BLOCK>(i);
+
+        if (in_baseline){
+            baseline_sum += block.sum();
+        }
+        if (saturation_level > 0){
+            n_saturated += ( block.abs() >= saturation_level ).count();
+        }
+        if (in_window){
+            // Only look for the position in the block if it holds a new maximum or minimum
+            int block_max = block.maxCoeff();
+            if (block_max > value_max){
+                int k = 0;
+                while (block(k) != block_max){
+                    k++;
+                }
+                value_max = block_max;
+                t_value_max = i+k;
+            }
+            int block_min = block.minCoeff();
+            if (block_min < value_min){
+                int k = 0;
+                while (block(k) != block_min){
+                    k++;
+                }
+                value_min = block_min;
+                t_value_min = i+k;
+            }
+        }
+    }
+    for (; i<size_scan; i++){
+        scan_sample(i);
+    }
+
+    // Store the results
+    preprocessed.pedestal = size_baseline > 0 ? (float)baseline_sum / size_baseline : 0;
+    preprocessed.n_saturated = n_saturated;
+    if (search_peak){
+        if (config.peak_abs && preprocessed.pedestal - value_min > value_max - preprocessed.pedestal){
+            preprocessed.t_max = t_value_min;
+        }
+        else if (config.peak_abs && preprocessed.pedestal - value_min == value_max - preprocessed.pedestal){
+            preprocessed.t_max = min(t_value_max,t_value_min);
+        }
+        else{
+            preprocessed.t_max = t_value_max;
+        }
+    }
+
+    return;
+}
+
+
+/*
+Converts the trace segment to float and subtracts the pedestal, into the scratch buffer `preprocessed.segment`.
+The buffer is only reallocated if the size of the segment changes.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`sample_start_segment` : Sample of the trace where the segment starts.
+
+`size_segment` : Number of samples of the segment.
+
+`preprocessed` : Preprocessed trace with the pedestal set by `scan_trace`.
+*/
+void convert_segment(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                     const int& sample_start_segment,
+                     const int& size_segment,
+                     PreprocessedTrace& preprocessed){
+    preprocessed.sample_start_segment = sample_start_segment;
+    preprocessed.segment.resize(size_segment);
+    preprocessed.segment = trace.segment(sample_start_segment,size_segment).cast<float>() - preprocessed.pedestal;
+
+    return;
+}
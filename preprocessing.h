@@ -0,0 +1,82 @@
+/*
+///////////////////////////////////
+//** PREPROCESSING HEADER FILE ** //
+///////////////////////////////////
+
+This file defines the fused preprocessing of an input ADC trace of the Template FLT-1.
+In a single vectorized pass over the trace, the preprocessing:
+- estimates the pedestal from the first `size_baseline` samples,
+- searches the (signed or absolute) trace maximum within the FLT-0 window of the event,
+- counts the samples at or above the ADC saturation level.
+The trace segment around the maximum is then converted to float and pedestal-subtracted
+into a scratch buffer, which is reused by all correlation engines and the pre-filter.
+The samples are not modified: the number of saturated samples is passed on to `FitResult::n_saturated`,
+which flags saturated traces to the caller.
+*/
+
+#ifndef PREPROCESSING_H
+#define PREPROCESSING_H
+
+#include <eigen3/Eigen/Dense>
+
+/*
+---------
+CONSTANTS
+---------
+*/
+
+// FLT-0 window that stands for the default window `PreprocessConfig::window_start/window_end`
+const Eigen::Array2i WINDOW_FLT0_DEFAULT(-1,0);
+
+/*
+-------
+STRUCTS
+-------
+*/
+
+// Configuration of the preprocessing
+struct PreprocessConfig{
+    // Number of samples at the start of the trace used to estimate the pedestal, 0 = no pedestal subtraction
+    int size_baseline = 0;
+    // Search the maximum of abs(trace - pedestal) instead of the maximum of the trace
+    bool peak_abs = false;
+    // Default FLT-0 window [start,end) in which the trace maximum is searched, end = 0 means the end of the trace
+    // Used for the traces that are not given the FLT-0 window of their event, see `scan_trace`
+    int window_start = 0;
+    int window_end = 0;
+    // ADC saturation level, samples with |sample| >= saturation_level are counted as saturated, 0 = no saturation check
+    int saturation_level = 0;
+};
+
+// Result of the preprocessing of a trace
+struct PreprocessedTrace{
+    // Pedestal subtracted from the trace
+    float pedestal = 0;
+    // Position of the trace maximum
+    int t_max = 0;
+    // Number of saturated samples of the trace
+    int n_saturated = 0;
+    // Sample of the trace where the segment starts
+    int sample_start_segment = 0;
+    // Pedestal-subtracted trace segment around the trace maximum (scratch buffer of the correlation)
+    Eigen::ArrayXf segment;
+};
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+void scan_trace(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                const PreprocessConfig& config,
+                const Eigen::Array2i& window_flt0,
+                const bool& search_peak,
+                PreprocessedTrace& preprocessed);
+
+void convert_segment(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                     const int& sample_start_segment,
+                     const int& size_segment,
+                     PreprocessedTrace& preprocessed);
+
+#endif // PREPROCESSING_H
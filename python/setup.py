@@ -0,0 +1,37 @@
+# Build of the optional Python extension module `template_flt`.
+# Install from the repository root with: pip install ./python
+
+import os
+from setuptools import setup
+from pybind11.setup_helpers import Pybind11Extension, build_ext
+
+# Directory of this file, and the repository root one level up
+# All paths are anchored at this file, such that the build does not depend on the working directory
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.dirname(HERE)
+
+# Sources of the core library, relative to the repository root
+SOURCES = ["template_FLT.cpp",
+           "prefilter.cpp",
+           "polyphase.cpp",
+           "preprocessing.cpp",
+           "autotune.cpp",
+           "utils.cpp",
+           "error_handling.cpp"]
+
+ext_modules = [
+    Pybind11Extension("template_flt",
+                      [os.path.join(HERE, "template_flt_python.cpp")]
+                      + [os.path.join(ROOT, source) for source in SOURCES],
+                      include_dirs=[ROOT],
+                      cxx_std=17,
+                      extra_compile_args=["-O3"],
+                      extra_link_args=["-pthread"]),
+]
+
+setup(name="template_flt",
+      version="0.1",
+      description="Batch template fit of the Template FLT-1",
+      ext_modules=ext_modules,
+      cmdclass={"build_ext": build_ext},
+      install_requires=["numpy"])
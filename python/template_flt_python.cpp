@@ -0,0 +1,226 @@
+/*
+////////////////////////////////////////////
+//** TEMPLATE FLT PYTHON MODULE SOURCE ** //
+////////////////////////////////////////////
+
+Optional Python extension module `template_flt` exposing a batch template fit over NumPy arrays,
+such that offline studies run the exact production template fit.
+
+The traces are accessed without copy if they are passed as a C-contiguous int32 NumPy array
+(other dtypes or layouts are converted once). The GIL is released while fitting,
+and the traces are split over several threads that share one TemplateFLT, each with its own scratch.
+
+Build and install from the repository root (requires pybind11 and NumPy):
+    pip install ./python
+
+Example:
+    import numpy as np
+    import template_flt
+
+    fitter = template_flt.BatchFitter("templates_96_XY_rfv2.txt", engine="packed")
+    traces = np.ascontiguousarray(traces, dtype=np.int32)   # shape (N_traces, N_samples)
+    t_max = traces.argmax(axis=1)                           # shape (N_traces,)
+    result = fitter.fit(traces, t_max, n_threads=8)
+    result["corr_max_best"]                                 # shape (N_traces,)
+*/
+
+#include <thread>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include "../template_FLT.h"
+
+namespace py = pybind11;
+
+using namespace std;
+
+/*
+Batch template fit of many traces with one template library.
+*/
+class BatchFitter{
+    private:
+        // TemplateFLT that holds the template library
+        TemplateFLT flt;
+
+    public:
+        BatchFitter(const string& template_file_name,
+                    const int& adc_sampling_rate,
+                    const int& sim_sampling_rate,
+                    const int& size_template,
+                    const int& sample_peak_template,
+                    const pair<int,int>& corr_window,
+                    const string& engine)
+            : flt(template_file_name,
+                  adc_sampling_rate,
+                  sim_sampling_rate,
+                  size_template,
+                  sample_peak_template,
+                  Eigen::Array2i(corr_window.first,corr_window.second)){
+            set_engine(engine);
+        }
+
+        void set_engine(const string& engine){
+            for (const FitEngine& fit_engine : get_fit_engines()){
+                if (fit_engine_name(fit_engine) == engine){
+                    flt.set_fit_engine(fit_engine);
+                    return;
+                }
+            }
+            throw invalid_argument("Unknown engine: " + engine);
+        }
+
+        string get_engine(){
+            return fit_engine_name( flt.get_fit_engine() );
+        }
+
+        int get_n_templates(){
+            return flt.templates.size();
+        }
+
+        int get_desampling_factor(){
+            return flt.get_desampling_factor();
+        }
+
+        /*
+        Performs the template fit for all traces.
+
+        Arguments
+        ---------
+        `traces` : 2D array of ADC traces of shape (N_traces, N_samples).
+
+        `t_max` : 1D array of the positions of the trace maxima of shape (N_traces,), all < N_samples.
+                  Negative positions are searched within the default FLT-0 window of the preprocessing.
+
+        `n_threads` : Number of threads. Default is 0 = number of hardware threads.
+
+        Returns
+        -------
+        `result` : Dict of 1D arrays of shape (N_traces,) with the template-fit results
+                   `template_id_best`, `idx_template_desampled_best`, `t_peak_best` and `corr_max_best`.
+                   For traces that are not fitted (trace maximum too close to the trace edge) or where the fit fails,
+                   the IDs are set to -1 and the correlation to NaN.
+        */
+        py::dict fit(const py::array_t<int32_t, py::array::c_style | py::array::forcecast>& traces,
+                     const py::array_t<int, py::array::c_style | py::array::forcecast>& t_max,
+                     int n_threads){
+            if (traces.ndim() != 2){
+                throw invalid_argument("traces must be a 2D array of shape (N_traces, N_samples)");
+            }
+            if (t_max.ndim() != 1 || t_max.shape(0) != traces.shape(0)){
+                throw invalid_argument("t_max must be a 1D array of shape (N_traces,)");
+            }
+
+            ssize_t n_traces = traces.shape(0);
+            ssize_t n_samples = traces.shape(1);
+
+            // Trace maxima beyond the traces are rejected before any fit
+            for (ssize_t n=0; n<n_traces; n++){
+                if (t_max.data()[n] >= n_samples){
+                    throw invalid_argument("t_max[" + to_string(n) + "]=" + to_string(t_max.data()[n])
+                                           + " must be < N_samples=" + to_string(n_samples));
+                }
+            }
+
+            py::array_t<int32_t> template_id_best(n_traces);
+            py::array_t<int32_t> idx_template_desampled_best(n_traces);
+            py::array_t<int32_t> t_peak_best(n_traces);
+            py::array_t<float> corr_max_best(n_traces);
+
+            // Raw pointers, only accessed while the GIL is released
+            const int32_t* traces_data = traces.data();
+            const int* t_max_data = t_max.data();
+            int32_t* template_id_data = template_id_best.mutable_data();
+            int32_t* idx_desampled_data = idx_template_desampled_best.mutable_data();
+            int32_t* t_peak_data = t_peak_best.mutable_data();
+            float* corr_max_data = corr_max_best.mutable_data();
+
+            if (n_threads <= 0){
+                n_threads = max(1u,thread::hardware_concurrency());
+            }
+            n_threads = min<ssize_t>(n_threads,max<ssize_t>(n_traces,1));
+
+            {
+                py::gil_scoped_release release;
+
+                // Each thread fits a contiguous chunk of traces with the shared TemplateFLT and its own scratch
+                auto fit_chunk = [&](ssize_t start, ssize_t end){
+                    FitScratch scratch = flt.make_scratch();
+                    for (ssize_t n=start; n<end; n++){
+                        // Zero-copy view of trace n
+                        Eigen::Map<const Eigen::ArrayXi> trace(traces_data + n*n_samples,n_samples);
+                        FitResult result;
+                        try{
+                            result = flt.template_fit(trace,t_max_data[n],scratch);
+                        }
+                        catch (const exception& err){
+                            result = FitResult();
+                        }
+                        // Traces that were not fitted
+                        if (result.n_templates_evaluated == 0){
+                            template_id_data[n] = -1;
+                            idx_desampled_data[n] = -1;
+                            t_peak_data[n] = -1;
+                            corr_max_data[n] = NAN;
+                        }
+                        else{
+                            template_id_data[n] = result.template_id_best;
+                            idx_desampled_data[n] = result.idx_template_desampled_best;
+                            t_peak_data[n] = result.t_peak_best;
+                            corr_max_data[n] = result.corr_max_best;
+                        }
+                    }
+                };
+
+                vector<thread> threads;
+                ssize_t size_chunk = (n_traces + n_threads - 1) / n_threads;
+                for (int t=0; t<n_threads; t++){
+                    ssize_t start = t*size_chunk;
+                    ssize_t end = min(start+size_chunk,n_traces);
+                    if (start < end){
+                        threads.emplace_back(fit_chunk,start,end);
+                    }
+                }
+                for (thread& t : threads){
+                    t.join();
+                }
+            }
+
+            py::dict result;
+            result["template_id_best"] = template_id_best;
+            result["idx_template_desampled_best"] = idx_template_desampled_best;
+            result["t_peak_best"] = t_peak_best;
+            result["corr_max_best"] = corr_max_best;
+
+            return result;
+        }
+};
+
+
+PYBIND11_MODULE(template_flt, m){
+    m.doc() = "Batch template fit of the Template FLT-1";
+
+    py::class_<BatchFitter>(m,"BatchFitter")
+        .def(py::init<const string&,const int&,const int&,const int&,const int&,const pair<int,int>&,const string&>(),
+             py::arg("template_file_name"),
+             py::arg("adc_sampling_rate") = 500,
+             py::arg("sim_sampling_rate") = 2000,
+             py::arg("size_template") = 400,
+             py::arg("sample_peak_template") = 120,
+             py::arg("corr_window") = make_pair(-10,10),
+             py::arg("engine") = "packed")
+        .def_property("engine",&BatchFitter::get_engine,&BatchFitter::set_engine)
+        .def_property_readonly("n_templates",&BatchFitter::get_n_templates)
+        .def_property_readonly("desampling_factor",&BatchFitter::get_desampling_factor)
+        .def("fit",&BatchFitter::fit,
+             py::arg("traces"),
+             py::arg("t_max"),
+             py::arg("n_threads") = 0);
+
+    m.def("fit_engines",[](){
+        vector<string> names;
+        for (const FitEngine& fit_engine : get_fit_engines()){
+            names.push_back( fit_engine_name(fit_engine) );
+        }
+        return names;
+    });
+}
@@ -0,0 +1,58 @@
+# Tests of the Python extension module `template_flt`.
+# Install the module with `pip install ./python`, then run from the repository root with: pytest python
+
+import os
+
+import numpy as np
+import pytest
+
+import template_flt
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+TEST_TRACE_FILE = os.path.join(ROOT, "test_trace.txt")
+TEMPLATES_XY_FILE = os.path.join(ROOT, "templates_96_XY_rfv2.txt")
+
+# Result of the C++ template fit of the X and Y traces of `test_trace.txt`, as printed by `main`
+# (template_id_best, idx_template_desampled_best, t_peak_best, corr_max_best)
+RESULT_CPP = [(41, 0, 711, 0.544931),
+              (89, 0, 490, 0.643465)]
+
+
+def load_traces():
+    # X and Y polarizations, same as `main`
+    return np.ascontiguousarray(np.loadtxt(TEST_TRACE_FILE)[:2], dtype=np.int32)
+
+
+@pytest.mark.parametrize("engine", template_flt.fit_engines())
+def test_fit_matches_cpp(engine):
+    fitter = template_flt.BatchFitter(TEMPLATES_XY_FILE, engine=engine)
+    traces = load_traces()
+
+    # t_max = -1: the trace maximum is searched in the fused preprocessing pass, same as `main`
+    result = fitter.fit(traces, np.full(len(traces), -1), n_threads=2)
+
+    for n, (template_id, idx_desampled, t_peak, corr_max) in enumerate(RESULT_CPP):
+        assert result["template_id_best"][n] == template_id
+        assert result["idx_template_desampled_best"][n] == idx_desampled
+        assert result["t_peak_best"][n] == t_peak
+        assert result["corr_max_best"][n] == pytest.approx(corr_max, abs=1e-5)
+
+
+def test_t_max_beyond_trace():
+    fitter = template_flt.BatchFitter(TEMPLATES_XY_FILE)
+    traces = load_traces()
+
+    with pytest.raises(ValueError):
+        fitter.fit(traces, np.array([100, traces.shape[1]]))
+
+
+def test_t_max_at_trace_edge():
+    fitter = template_flt.BatchFitter(TEMPLATES_XY_FILE)
+    traces = load_traces()
+
+    # The segment around the last sample is shorter than a template: that trace is not fitted
+    result = fitter.fit(traces, np.array([traces.shape[1]-1, -1]))
+
+    assert result["template_id_best"][0] == -1
+    assert np.isnan(result["corr_max_best"][0])
+    assert result["template_id_best"][1] == RESULT_CPP[1][0]
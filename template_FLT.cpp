@@ -3,12 +3,84 @@
 ///////////////////////////////////
 
 #include <fstream>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
 #include "template_FLT.h"
 #include "error_handling.h"
 #include "utils.h"
 
 using namespace std;
 
+// Number of anytime fits after which the template priority is sorted again by number of wins
+const int N_FITS_PRIORITY = 1024;
+// Block sizes of the packed engine timed by the autotuner, 0 = all templates
+const vector<int> SIZE_BLOCKS_AUTOTUNE = {0,1,4,16,64};
+// Absolute tolerance on `corr_max_best` when the autotuner verifies a candidate against the reference engine
+const float CORR_TOL_AUTOTUNE = 1e-4;
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+/*
+Returns all available correlation engines.
+The first entry is always the reference engine.
+*/
+vector<FitEngine> get_fit_engines(){
+    return {FitEngine::REFERENCE,
+            FitEngine::PACKED,
+            FitEngine::ANYTIME,
+            FitEngine::POLYPHASE};
+}
+
+
+/*
+Returns the name of a correlation engine.
+
+Arguments
+---------
+`fit_engine` : The correlation engine.
+*/
+string fit_engine_name(const FitEngine& fit_engine){
+    switch (fit_engine){
+        case FitEngine::REFERENCE:
+            return "reference";
+        case FitEngine::PACKED:
+            return "packed";
+        case FitEngine::ANYTIME:
+            return "anytime";
+        case FitEngine::POLYPHASE:
+            return "polyphase";
+    }
+
+    return "unknown";
+}
+
+
+/*
+Returns the correlation engine with a given name, see `fit_engine_name`.
+
+Arguments
+---------
+`name` : Name of the correlation engine.
+*/
+FitEngine fit_engine_from_name(const string& name){
+    for (const FitEngine& fit_engine : get_fit_engines()){
+        if (fit_engine_name(fit_engine) == name){
+            return fit_engine;
+        }
+    }
+
+    string err_msg = "Unknown correlation engine: " + name;
+    throwError(err_msg,__FILE__,__LINE__);
+
+    return FitEngine::REFERENCE;
+}
+
+
 /*
 ------------
 CONSTRUCTORS
@@ -27,6 +99,12 @@ TemplateFLT::TemplateFLT(){
    this->sample_peak_template = 0;
    this->sample_peak_template_desampled = 0;
    this->corr_window = {0,0};
+   this->corr_thresh = 0;
+   this->fit_engine = FitEngine::REFERENCE;
+   this->size_block = 0;
+   this->time_budget = 0;
+   this->n_phases = 0;
+   this->n_taps = 16;
 }
 
 
@@ -59,6 +137,12 @@ TemplateFLT::TemplateFLT(const string& template_file_name,
     this->sim_sampling_rate = sim_sampling_rate;
     this->desampling_factor = sim_sampling_rate/adc_sampling_rate;
     this->corr_window = corr_window;
+    this->corr_thresh = 0;
+    this->fit_engine = FitEngine::REFERENCE;
+    this->size_block = 0;
+    this->time_budget = 0;
+    this->n_phases = 0;
+    this->n_taps = 16;
 
     load_templates(template_file_name,size_template,sample_peak_template);
 }
@@ -140,6 +224,189 @@ void TemplateFLT::set_corr_thresh(const float& corr_thresh){
     // Set the value
     this->corr_thresh = corr_thresh;
 
+    // Derive the subspace cut of the pre-filter from the new threshold
+    this->prefilter.set_corr_thresh(corr_thresh);
+
+    return;
+}
+
+
+/*
+Setter for `fit_engine`.
+
+Arguments
+---------
+`fit_engine` : Correlation engine used by `template_fit`.
+*/
+void TemplateFLT::set_fit_engine(const FitEngine& fit_engine){
+    this->fit_engine = fit_engine;
+
+    return;
+}
+
+
+/*
+Setter for `size_block`, the number of templates per matrix product of the packed engine.
+Smaller blocks keep the correlations of a block in cache for large template libraries.
+
+Arguments
+---------
+`size_block` : Number of templates per block. 0 = all templates in one matrix product.
+*/
+void TemplateFLT::set_size_block(const int& size_block){
+    // Check that the block size is not negative
+    if (size_block < 0){
+        string err_msg = "Block size must be >= 0!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    this->size_block = size_block;
+
+    return;
+}
+
+
+/*
+Setter for the configuration of the autotuner.
+If enabled, the autotuner runs immediately if templates are loaded, and whenever the templates are desampled.
+
+Arguments
+---------
+`autotune_config` : Configuration of the autotuner, see `autotune.h`.
+*/
+void TemplateFLT::set_autotune_config(const AutotuneConfig& autotune_config){
+    // Check that the benchmark times at least one pass over at least one trace
+    if (autotune_config.n_traces < 1 || autotune_config.n_repeats < 1){
+        string err_msg = "Autotune needs n_traces >= 1 and n_repeats >= 1!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    this->autotune_config = autotune_config;
+
+    if (autotune_config.enabled && !templates_desampled.empty()){
+        autotune();
+    }
+
+    return;
+}
+
+
+/*
+Setter for the configuration of the pre-filter.
+The cut on the subspace correlation is derived from `corr_thresh`, also when it changes later.
+Resets the pre-filter counters of the non-const `trigger`.
+
+Arguments
+---------
+`prefilter_config` : Configuration of the pre-filter cuts, see `prefilter.h`.
+*/
+void TemplateFLT::set_prefilter_config(const PreFilterConfig& prefilter_config){
+    // Check that templates have been loaded
+    if (templates_desampled.size() < 1){
+        string err_msg = "No templates have been loaded yet!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    this->prefilter = PreFilter(templates_desampled,prefilter_config,this->corr_thresh);
+    this->scratch.prefilter_stats = PreFilterStats();
+
+    return;
+}
+
+
+/*
+Setter for the configuration of the fused preprocessing.
+
+Arguments
+---------
+`preprocess_config` : Configuration of the preprocessing, see `preprocessing.h`.
+*/
+void TemplateFLT::set_preprocess_config(const PreprocessConfig& preprocess_config){
+    this->preprocess_config = preprocess_config;
+
+    return;
+}
+
+
+/*
+Setter for `time_budget` of the anytime fit.
+
+Arguments
+---------
+`time_budget` [ns] : Time budget of the anytime fit, measured from the arrival time of the trace
+                     passed to the const `template_fit` or `trigger`, else from the start of the fit. 0 = unlimited.
+                     A budget in CPU cycles can be converted with the (fixed) CPU frequency.
+*/
+void TemplateFLT::set_time_budget(const long& time_budget){
+    // Check that the budget is not negative
+    if (time_budget < 0){
+        string err_msg = "Time budget must be >= 0!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    this->time_budget = time_budget;
+
+    return;
+}
+
+
+/*
+Setter for `template_priority`, the order in which the anytime fit evaluates the templates.
+The priority is still updated by the number of wins of each template during the fit.
+Applies to the scratch of the non-const fit methods and to scratches made afterwards.
+
+Arguments
+---------
+`template_priority` : Permutation of the template IDs, highest priority first.
+*/
+void TemplateFLT::set_template_priority(const vector<int>& template_priority){
+    // Check that the priority is a permutation of all template IDs
+    // The size is checked first, such that an empty priority is rejected too
+    string err_msg = "Template priority must be a permutation of all " + to_string(templates.size()) + " template IDs!";
+    if (template_priority.size() != templates.size()){
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+    vector<int> template_ids = template_priority;
+    sort(template_ids.begin(),template_ids.end());
+    for (int i=0; i<(int)template_ids.size(); i++){
+        if (template_ids[i] != i){
+            throwError(err_msg,__FILE__,__LINE__);
+        }
+    }
+
+    this->template_priority = template_priority;
+    this->scratch.template_priority = template_priority;
+
+    return;
+}
+
+
+/*
+Setter for the number of phases of the polyphase engine.
+Rebuilds the polyphase filter bank.
+
+Arguments
+---------
+`n_phases` : Number of phases per desampled template. 0 = desampling factor.
+             Can be larger than the desampling factor for a finer sub-sample timing.
+
+`n_taps` : Number of taps of the interpolation filters. Must be even. Default is 16.
+*/
+void TemplateFLT::set_n_phases(const int& n_phases,
+                               const int& n_taps){
+    // Check that the number of phases is not negative
+    if (n_phases < 0){
+        string err_msg = "Number of phases must be >= 0!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    // Build the filter bank first, such that the object is unchanged if the configuration is invalid
+    PolyphaseFilterBank polyphase(desampling_factor,n_phases > 0 ? n_phases : desampling_factor,n_taps);
+
+    this->n_phases = n_phases;
+    this->n_taps = n_taps;
+    this->polyphase = polyphase;
+
     return;
 }
 
@@ -153,66 +420,150 @@ GETTERS
 /*
 Getter for `adc_sampling_rate`.
 */
-int TemplateFLT::get_adc_sampling_rate(){
+int TemplateFLT::get_adc_sampling_rate() const{
     return this->adc_sampling_rate;
 }
 
 /*
 Getter for `sim_sampling_rate`.
 */
-int TemplateFLT::get_sim_sampling_rate(){
+int TemplateFLT::get_sim_sampling_rate() const{
     return this->sim_sampling_rate;
 }
 
 /*
 Getter for `desampling_factor`.
 */
-int TemplateFLT::get_desampling_factor(){
+int TemplateFLT::get_desampling_factor() const{
     return this->desampling_factor;
 }
 
 /*
 Getter for `size_template`.
 */
-int TemplateFLT::get_size_template(){
+int TemplateFLT::get_size_template() const{
     return this->size_template;
 }
 
 /*
 Getter for `size_template_desampled`.
 */
-int TemplateFLT::get_size_template_desampled(){
+int TemplateFLT::get_size_template_desampled() const{
     return this->size_template_desampled;
 }
 
 /*
 Getter for `sample_peak_template`.
 */
-int TemplateFLT::get_sample_peak_template(){
+int TemplateFLT::get_sample_peak_template() const{
     return this->sample_peak_template;
 }
 
 /*
 Getter for `sample_peak_template_desampled`.
 */
-int TemplateFLT::get_sample_peak_template_desampled(){
+int TemplateFLT::get_sample_peak_template_desampled() const{
     return this->sample_peak_template_desampled;
 }
 
 /*
 Getter for `corr_window`.
 */
-Eigen::Array2i TemplateFLT::get_corr_window(){
+Eigen::Array2i TemplateFLT::get_corr_window() const{
     return this->corr_window;
 }
 
 /*
 Getter for `corr_thresh`.
 */
-float TemplateFLT::get_corr_thresh(){
+float TemplateFLT::get_corr_thresh() const{
     return this->corr_thresh;
 }
 
+/*
+Getter for `fit_engine`.
+*/
+FitEngine TemplateFLT::get_fit_engine() const{
+    return this->fit_engine;
+}
+
+/*
+Getter for `size_block`.
+*/
+int TemplateFLT::get_size_block() const{
+    return this->size_block;
+}
+
+/*
+Getter for the configuration of the autotuner.
+*/
+AutotuneConfig TemplateFLT::get_autotune_config() const{
+    return this->autotune_config;
+}
+
+/*
+Getter for the decision of the last run of the autotuner, with the measured times of all candidates.
+*/
+AutotuneResult TemplateFLT::get_autotune_result() const{
+    return this->autotune_result;
+}
+
+/*
+Getter for the configuration of the pre-filter.
+*/
+PreFilterConfig TemplateFLT::get_prefilter_config() const{
+    return this->prefilter.get_config();
+}
+
+/*
+Getter for the counters of the pre-filter of the non-const `trigger`.
+*/
+PreFilterStats TemplateFLT::get_prefilter_stats() const{
+    return this->scratch.prefilter_stats;
+}
+
+/*
+Getter for the configuration of the fused preprocessing.
+*/
+PreprocessConfig TemplateFLT::get_preprocess_config() const{
+    return this->preprocess_config;
+}
+
+/*
+Getter for `time_budget` [ns].
+*/
+long TemplateFLT::get_time_budget() const{
+    return this->time_budget;
+}
+
+/*
+Getter for the current template priority of the non-const anytime fit.
+*/
+vector<int> TemplateFLT::get_template_priority() const{
+    return this->scratch.template_priority;
+}
+
+/*
+Getter for the counters of the non-const anytime fit.
+*/
+BudgetStats TemplateFLT::get_budget_stats() const{
+    return this->scratch.budget_stats;
+}
+
+/*
+Getter for the number of phases of the polyphase engine.
+*/
+int TemplateFLT::get_n_phases() const{
+    return this->polyphase.get_n_phases();
+}
+
+/*
+Getter for the preprocessed trace of the last non-const fit.
+*/
+PreprocessedTrace TemplateFLT::get_preprocessed() const{
+    return this->scratch.preprocessed;
+}
+
 
 /*
 -------
@@ -342,16 +693,281 @@ void TemplateFLT::desample_templates(){
     cout << "    into " << this->desampling_factor << " desampled templates of " << this->size_template_desampled << " samples" << endl;
     cout << "    at ADC sampling rate of " << this->adc_sampling_rate << " MHz" << endl;
 
+    // Pack the desampled templates for the optimized engines
+    pack_templates();
+
+    // Build the polyphase filter bank
+    set_n_phases(this->n_phases,this->n_taps);
+
+    // Update the mean template and the principal components of the pre-filter
+    this->prefilter = PreFilter(this->templates_desampled,this->prefilter.get_config(),this->corr_thresh);
+
+    // Select the fastest engine for the new templates
+    if (autotune_config.enabled){
+        autotune();
+    }
+
+    return;
+}
+
+
+/*
+Returns the key of the autotuner decision for the current configuration and CPU.
+The key includes the configuration of `template_fit`, including the preprocessing, which is timed with it.
+The pre-filter and the correlation threshold are not included, since the autotuner only times `template_fit`.
+*/
+string TemplateFLT::get_autotune_key() const{
+    ostringstream oss;
+    oss << get_cpu_model()
+        << ";n_templates=" << templates.size()
+        << ";size_template_desampled=" << size_template_desampled
+        << ";desampling_factor=" << desampling_factor
+        << ";corr_window=" << corr_window(0) << "," << corr_window(1)
+        << ";n_phases=" << polyphase.get_n_phases()
+        << ";n_taps=" << polyphase.get_n_taps()
+        << ";preprocess=" << preprocess_config.size_baseline
+        << "," << preprocess_config.peak_abs
+        << "," << preprocess_config.window_start
+        << "," << preprocess_config.window_end
+        << "," << preprocess_config.saturation_level;
+
+    return oss.str();
+}
+
+
+/*
+Selects the fastest correlation engine for the current configuration and CPU, and sets it with
+`set_fit_engine` and `set_size_block`.
+
+The candidates are all engines that yield the same result as the reference engine:
+the reference engine, the packed engine with the block sizes SIZE_BLOCKS_AUTOTUNE,
+and the polyphase engine if its number of phases is the desampling factor.
+The anytime engine is not a candidate, since its result depends on the time budget.
+Each candidate is timed with the const `template_fit` on synthetic traces, see `make_autotune_traces`.
+Before it is selected, the fastest candidate is verified against the reference engine on the same traces:
+`template_id_best`, `idx_template_desampled_best` and `t_peak_best` must be identical and `corr_max_best`
+must agree within CORR_TOL_AUTOTUNE. Otherwise the next fastest candidate is verified.
+
+The decision is read from the cache file of `autotune_config` if it contains the key of the
+current configuration and CPU, see `get_autotune_key`, and names a known engine. Otherwise the candidates
+are timed and the decision is written to the cache file.
+
+Returns
+-------
+`result` : Decision of the autotuner with the measured times of all candidates, also kept for `get_autotune_result`.
+*/
+AutotuneResult TemplateFLT::autotune(){
+    AutotuneResult result;
+    result.key = get_autotune_key();
+
+    bool cached = !autotune_config.cache_file.empty()
+                  && load_autotune_result(autotune_config.cache_file,result.key,result);
+
+    // A decision with an unknown engine (e.g. from another version) is a cache miss
+    if (cached){
+        bool known = false;
+        for (const FitEngine& fit_engine : get_fit_engines()){
+            known = known || fit_engine_name(fit_engine) == result.fit_engine;
+        }
+        if (!known || result.size_block < 0){
+            cout << ">>> Autotune cache entry with unknown engine " << result.fit_engine << " ignored" << endl;
+            result = AutotuneResult();
+            result.key = get_autotune_key();
+            cached = false;
+        }
+    }
+
+    if (!cached){
+        // Synthetic traces with room for the segment around the trace maximum
+        int size_segment = ( corr_window(1) - corr_window(0) ) + size_template_desampled;
+        int size_trace = max(1024,4*size_segment);
+        vector<Eigen::ArrayXi> traces;
+        vector<int> t_maxs;
+        make_autotune_traces(templates_desampled,
+                             sample_peak_template_desampled,
+                             size_trace,
+                             autotune_config.n_traces,
+                             autotune_config.seed,
+                             traces,
+                             t_maxs);
+
+        // Candidates yielding the same result as the reference engine
+        vector< pair<FitEngine,int> > candidates = {{FitEngine::REFERENCE,0}};
+        for (const int& size_block : SIZE_BLOCKS_AUTOTUNE){
+            if (size_block < (int)templates.size()){
+                candidates.push_back({FitEngine::PACKED,size_block});
+            }
+        }
+        if (polyphase.get_n_phases() == desampling_factor){
+            candidates.push_back({FitEngine::POLYPHASE,0});
+        }
+
+        // Time each candidate, the first pass warms up the caches and keeps the results for the verification
+        FitScratch scratch = make_scratch();
+        vector< vector<FitResult> > results_candidates(candidates.size());
+        for (size_t c=0; c<candidates.size(); c++){
+            const pair<FitEngine,int>& candidate = candidates[c];
+            this->fit_engine = candidate.first;
+            this->size_block = candidate.second;
+
+            double time_per_fit = 0;
+            for (int r=0; r<=autotune_config.n_repeats; r++){
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                for (size_t n=0; n<traces.size(); n++){
+                    if (r == 0){
+                        results_candidates[c].push_back( template_fit(traces[n],t_maxs[n],scratch) );
+                    }
+                    else{
+                        template_fit(traces[n],t_maxs[n],scratch);
+                    }
+                }
+                double time = 1e6*chrono::duration<double>(chrono::steady_clock::now()-start).count() / traces.size();
+                if (r == 1 || (r > 1 && time < time_per_fit)){
+                    time_per_fit = time;
+                }
+            }
+
+            result.timings.push_back({fit_engine_name(candidate.first),candidate.second,time_per_fit});
+        }
+
+        // Select the fastest candidate that yields the same fits as the reference engine (candidate 0)
+        vector<size_t> order(candidates.size());
+        iota(order.begin(),order.end(),0);
+        stable_sort(order.begin(),order.end(),
+                    [&result](const size_t& a, const size_t& b){ return result.timings[a].time_per_fit < result.timings[b].time_per_fit; });
+
+        const vector<FitResult>& results_reference = results_candidates[0];
+        for (const size_t& c : order){
+            int n_mismatches = 0;
+            for (size_t n=0; n<traces.size(); n++){
+                const FitResult& ref = results_reference[n];
+                const FitResult& out = results_candidates[c][n];
+                n_mismatches += out.template_id_best != ref.template_id_best
+                                || out.idx_template_desampled_best != ref.idx_template_desampled_best
+                                || out.t_peak_best != ref.t_peak_best
+                                || abs(out.corr_max_best - ref.corr_max_best) > CORR_TOL_AUTOTUNE;
+            }
+
+            if (n_mismatches == 0){
+                result.fit_engine = result.timings[c].fit_engine;
+                result.size_block = result.timings[c].size_block;
+                break;
+            }
+
+            cout << ">>> Autotune rejected the " << result.timings[c].fit_engine << " engine (block size "
+                 << result.timings[c].size_block << "): " << n_mismatches << " fits differ from the reference engine" << endl;
+        }
+
+        if (!autotune_config.cache_file.empty()){
+            save_autotune_result(autotune_config.cache_file,result);
+        }
+    }
+
+    // Apply the decision
+    this->fit_engine = fit_engine_from_name(result.fit_engine);
+    this->size_block = result.size_block;
+    this->autotune_result = result;
+
+    print_autotune_result(result);
+
+    return result;
+}
+
+
+/*
+Packs all desampled templates column-wise in one matrix of size size_template_desampled*(N_templates*desampling_factor).
+Column `i*desampling_factor+j` holds desampled template j of template i.
+Each column is divided by RMS(template)*size_template_desampled, such that the correlation
+normalization of `correlate` is already included in the packed templates.
+*/
+void TemplateFLT::pack_templates(){
+    int n_templates = templates_desampled.size();
+
+    templates_packed.resize(size_template_desampled,n_templates*desampling_factor);
+
+    for (int i=0; i<n_templates; i++){
+        for (int j=0; j<desampling_factor; j++){
+            Eigen::ArrayXf templ = templates_desampled[i][j].head(size_template_desampled);
+            templates_packed.col(i*desampling_factor+j) = ( templ / rms(templ) / templ.size() ).matrix();
+        }
+    }
+
+    // Initial priority of the anytime fit is the order of the template file
+    template_priority.resize(n_templates);
+    iota(template_priority.begin(),template_priority.end(),0);
+
+    // Set up the scratch of the non-const fit methods for the new templates
+    this->scratch = make_scratch();
+
     return;
 }
 
 
+/*
+Computes the best-fit time of the pulse peak with sub-sample resolution.
+Phase p of a desampled template samples the template with a delay of p*desampling_factor/n_phases
+simulation samples, such that its peak lies (sample_peak_template - delay)/desampling_factor samples after its start.
+
+Arguments
+---------
+`t_peak` : Best-fit time of the pulse peak, assuming the peak at `sample_peak_template_desampled`.
+
+`idx_phase` : Phase of the best-fit desampled template.
+
+`n_phases` : Number of phases per desampled template.
+*/
+float TemplateFLT::get_t_peak_fine(const int& t_peak,
+                                   const int& idx_phase,
+                                   const int& n_phases) const{
+    float delay = (float)idx_phase*desampling_factor/n_phases;
+
+    return t_peak - sample_peak_template_desampled + (sample_peak_template - delay)/desampling_factor;
+}
+
+
+/*
+Makes the result of a template fit of the packed, anytime and polyphase engines.
+
+Arguments
+---------
+`idx_best` : Index of the best-fit desampled template (or phase), = template_id*n_phases + phase.
+
+`t_best` : Window of the segment yielding the maximum correlation.
+
+`corr_max` : Maximum correlation.
+
+`n_phases` : Number of desampled templates (or phases) per template.
+
+`n_evaluated` : Number of templates evaluated.
+
+`preprocessed` : Preprocessed trace that was fitted.
+*/
+FitResult TemplateFLT::make_result(const int& idx_best,
+                                   const int& t_best,
+                                   const float& corr_max,
+                                   const int& n_phases,
+                                   const int& n_evaluated,
+                                   const PreprocessedTrace& preprocessed) const{
+    FitResult result;
+    result.template_id_best = idx_best / n_phases;
+    result.idx_template_desampled_best = idx_best % n_phases;
+    result.t_peak_best = t_best + preprocessed.sample_start_segment + this->sample_peak_template_desampled;
+    result.corr_max_best = corr_max;
+    result.t_peak_fine_best = get_t_peak_fine(result.t_peak_best,result.idx_template_desampled_best,n_phases);
+    result.fit_complete = n_evaluated == (int)templates.size();
+    result.n_templates_evaluated = n_evaluated;
+    result.n_saturated = preprocessed.n_saturated;
+
+    return result;
+}
+
+
 /*
 Computes the maximum abs(correlation) value of a trace and a template in the specified correlation window.
 
 Arguments
 ---------
-`trace` : Input ADC trace.
+`trace` : Preprocessed trace segment.
 
 `templ` : Template with same sampling rate as `trace`.
 
@@ -363,12 +979,12 @@ Returns
 0-> `t_best` : The sample of `trace` yielding the maximum correlation with `templ`.
 1-> `corr_max` : The maximum correlation value of `trace` with `templ`.
 */
-tuple<int,float> TemplateFLT::compute_max_correlation(const Eigen::ArrayXi& trace,
+tuple<int,float> TemplateFLT::compute_max_correlation(const Eigen::ArrayXf& trace,
                                                       const Eigen::ArrayXf& templ,
-                                                      const bool& norm){     
+                                                      const bool& norm) const{     
     // All correlation values (in absolute value) for the template and the trace
     // Normalized between [0,1] by default
-    Eigen::ArrayXf correlations_abs = correlate(trace.cast<float>(),templ,norm).abs();
+    Eigen::ArrayXf correlations_abs = correlate(trace,templ,norm).abs();
 
     // The best-fit time = sample of trace with largest correlation
     int t_best;
@@ -385,53 +1001,302 @@ tuple<int,float> TemplateFLT::compute_max_correlation(const Eigen::ArrayXi& trac
 
 
 /*
-Performs the template fit for a trace.
-For each template, the maximum correlation is computed in a window around the trace maximum.
-The template that yields the largest correlation is tagged as the best-fit template.
+Gets the bounds of the trace segment for which the correlation with the templates is computed.
+The segment is centered around the trace maximum such that the peaks of the trace and template "overlap".
+The segment is patched if it falls at the start or the end of the trace.
 
 Arguments
 ---------
-`trace` : Input ADC trace.
+`size_trace` : Number of samples of the input ADC trace.
 
 `t_max` : Position of the trace maximum around which `this->corr_window` will be centered.
-*/
-void TemplateFLT::template_fit(const Eigen::ArrayXi& trace,
-                               const int& t_max){
 
-    // Trace segment for which the correlation will be computed
-    Eigen::ArrayXi trace_segment;
+`sample_start_segment` : Set to the sample of the trace where the segment starts.
 
+`size_segment` : Set to the number of samples of the segment.
+*/
+void TemplateFLT::get_segment_bounds(const int& size_trace,
+                                     const int& t_max,
+                                     int& sample_start_segment,
+                                     int& size_segment) const{
     // Size of the segment
     // Correlation window size + number of samples of desampled template
-    int size_segment = ( corr_window(1) - corr_window(0) ) + (size_template_desampled);
-    //cout<<size_segment<<endl;
-    
+    size_segment = ( corr_window(1) - corr_window(0) ) + (size_template_desampled);
+
     // Starting sample of the segment
     // Sample of trace maximum - sample of template maximum
     // This way the peaks of the trace and template "overlap"
-    int sample_start_segment = t_max - this->sample_peak_template_desampled;
-    
-    // Get the relevant trace segment 
+    sample_start_segment = t_max - this->sample_peak_template_desampled;
+
     // Patch if window falls at the start of the trace
     if (sample_start_segment < 0){
-        trace_segment = trace.segment(0,size_segment+sample_start_segment);
+        size_segment = max(size_segment+sample_start_segment,0);
+        sample_start_segment = 0;
     }
     // Patch if the window is at the end of the trace
-    else if (sample_start_segment + size_segment > trace.size() - 1){
-        trace_segment = trace.segment(sample_start_segment,trace.size());
+    else if (sample_start_segment + size_segment > size_trace){
+        size_segment = size_trace - sample_start_segment;
     }
-    else{
-        trace_segment = trace.segment(sample_start_segment,size_segment);
+
+    return;
+}
+
+
+/*
+Preprocesses a trace with the fused preprocessing of `preprocessing.h`, configured with `set_preprocess_config`.
+In one pass over the trace, the pedestal is estimated, the trace maximum is searched within the FLT-0 window
+of the event if `t_max` < 0, and the saturated samples are counted. The trace segment around the trace maximum is then
+converted to float and pedestal-subtracted into `preprocessed.segment`, which is fitted by all engines.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`t_max` : Position of the trace maximum, < the size of the trace. If < 0, it is searched within the FLT-0 window.
+
+`preprocessed` : Set to the preprocessed trace. Its buffers are reused.
+
+`window_flt0` : FLT-0 window {start,end} of the event in which the trace maximum is searched if `t_max` < 0,
+                end = 0 means the end of the trace. Default = the FLT-0 window of the preprocessing configuration.
+*/
+void TemplateFLT::preprocess(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                             const int& t_max,
+                             PreprocessedTrace& preprocessed,
+                             const Eigen::Array2i& window_flt0) const{
+    // Check that the trace maximum lies within the trace
+    if (t_max >= trace.size()){
+        string err_msg = "Invalid argument: t_max=" + to_string(t_max) + " must be < the size of the trace=" + to_string(trace.size());
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    bool search_peak = t_max < 0;
+    if (!search_peak){
+        preprocessed.t_max = t_max;
+    }
+
+    scan_trace(trace,preprocess_config,window_flt0,search_peak,preprocessed);
+
+    int sample_start_segment, size_segment;
+    get_segment_bounds(trace.size(),preprocessed.t_max,sample_start_segment,size_segment);
+
+    convert_segment(trace,sample_start_segment,size_segment,preprocessed);
+
+    return;
+}
+
+
+/*
+Checks that a preprocessed segment is at least as long as a desampled template, such that it can be fitted.
+The segment of a trace maximum near the edges of the trace is patched, and can be shorter.
+*/
+bool TemplateFLT::is_fittable(const PreprocessedTrace& preprocessed) const{
+    return preprocessed.segment.size() >= size_template_desampled;
+}
+
+
+/*
+Sets up a scratch again if it was made before the templates changed.
+*/
+void TemplateFLT::check_scratch(FitScratch& scratch) const{
+    if (scratch.template_priority.size() != templates.size()){
+        scratch = make_scratch();
+    }
+
+    return;
+}
+
+
+/*
+Makes a scratch for the const `template_fit` and `trigger`.
+Each thread that fits traces with this object needs its own scratch.
+The scratch holds the preprocessed trace, the buffers of the correlation engines,
+the template priority and counters of the anytime fit, and the counters of the pre-filter.
+*/
+FitScratch TemplateFLT::make_scratch() const{
+    FitScratch scratch;
+
+    scratch.template_priority = this->template_priority;
+    scratch.template_wins.assign(templates.size(),0);
+    scratch.n_fits_since_priority = 0;
+
+    return scratch;
+}
+
+
+/*
+Stores the result of a fit in the public attributes, for the non-const fit methods.
+*/
+void TemplateFLT::store_result(const FitResult& result){
+    this->template_id_best = result.template_id_best;
+    this->idx_template_desampled_best = result.idx_template_desampled_best;
+    this->t_peak_best = result.t_peak_best;
+    this->corr_max_best = result.corr_max_best;
+    this->t_peak_fine_best = result.t_peak_fine_best;
+    this->fit_complete = result.fit_complete;
+    this->n_templates_evaluated = result.n_templates_evaluated;
+    this->n_saturated = result.n_saturated;
+
+    return;
+}
+
+
+/*
+Performs the template fit for a trace with the correlation engine set by `set_fit_engine`.
+For each template, the maximum correlation is computed in a window around the trace maximum.
+The template that yields the largest correlation is tagged as the best-fit template.
+
+This method does not modify the object: all mutable state is kept in `scratch`,
+such that one object can be shared by several threads, each with its own scratch.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`t_max` : Position of the trace maximum around which `this->corr_window` will be centered.
+          If < 0, it is searched within the FLT-0 window.
+
+`scratch` : Scratch of the calling thread, see `make_scratch`.
+
+`window_flt0` : FLT-0 window {start,end} of the event in which the trace maximum is searched if `t_max` < 0,
+                end = 0 means the end of the trace. Default = the FLT-0 window of the preprocessing configuration.
+
+`time_arrival` : Arrival time of the trace, from which the time budget of the anytime fit is counted,
+                 such that the time the trace waited before the fit is charged to its budget.
+                 Default = the start of the fit.
+
+Returns
+-------
+`result` : Result of the template fit, with `n_templates_evaluated` = 0 if the trace segment around `t_max`
+           is shorter than a desampled template (trace maximum near the edges of the trace).
+*/
+FitResult TemplateFLT::template_fit(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                                    const int& t_max,
+                                    FitScratch& scratch,
+                                    const Eigen::Array2i& window_flt0,
+                                    const chrono::steady_clock::time_point& time_arrival) const{
+    check_scratch(scratch);
+    preprocess(trace,t_max,scratch.preprocessed,window_flt0);
+
+    return fit_preprocessed(fit_engine,scratch,time_arrival);
+}
+
+
+/*
+Performs the template fit for a trace, see the const `template_fit`.
+Uses the scratch of this object, and stores the results in the public attributes.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`t_max` : Position of the trace maximum around which `this->corr_window` will be centered.
+          If < 0, it is searched within the FLT-0 window.
+
+`window_flt0` : FLT-0 window of the event, see the const `template_fit`.
+*/
+void TemplateFLT::template_fit(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                               const int& t_max,
+                               const Eigen::Array2i& window_flt0){
+    template_fit(trace,t_max,this->fit_engine,window_flt0);
+
+    return;
+}
+
+
+/*
+Performs the template fit for a trace with a given correlation engine instead of the one set by `set_fit_engine`.
+Uses the scratch of this object, and stores the results in the public attributes.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`t_max` : Position of the trace maximum around which `this->corr_window` will be centered.
+          If < 0, it is searched within the FLT-0 window.
+
+`fit_engine` : Correlation engine.
+
+`window_flt0` : FLT-0 window of the event, see the const `template_fit`.
+*/
+void TemplateFLT::template_fit(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                               const int& t_max,
+                               const FitEngine& fit_engine,
+                               const Eigen::Array2i& window_flt0){
+    check_scratch(this->scratch);
+    preprocess(trace,t_max,this->scratch.preprocessed,window_flt0);
+    store_result( fit_preprocessed(fit_engine,this->scratch,chrono::steady_clock::time_point()) );
+
+    return;
+}
+
+
+/*
+Performs the template fit of the preprocessed trace with a correlation engine.
+All engines fit the same preprocessed trace segment.
+A segment shorter than a desampled template (trace maximum near the edges of the trace) is not fitted:
+the result is then the default `FitResult`, with `n_templates_evaluated` = 0, for all engines.
+
+Arguments
+---------
+`fit_engine` : Correlation engine.
+
+`scratch` : Scratch holding the preprocessed trace.
+
+`time_arrival` : Arrival time of the trace, only used by the anytime engine, see `fit_anytime`.
+*/
+FitResult TemplateFLT::fit_preprocessed(const FitEngine& fit_engine,
+                                        FitScratch& scratch,
+                                        const chrono::steady_clock::time_point& time_arrival) const{
+    if (!is_fittable(scratch.preprocessed)){
+        FitResult result;
+        result.n_saturated = scratch.preprocessed.n_saturated;
+        return result;
+    }
+
+    switch (fit_engine){
+        case FitEngine::REFERENCE:
+            return fit_reference(scratch.preprocessed);
+        case FitEngine::PACKED:
+            return fit_packed(scratch);
+        case FitEngine::ANYTIME:
+            return fit_anytime(scratch,time_arrival);
+        case FitEngine::POLYPHASE:
+            return fit_polyphase(scratch);
     }
 
+    return FitResult();
+}
+
+
+/*
+Performs the template fit of a preprocessed trace with the reference engine.
+This implementation is frozen: all other engines are validated against it
+with `tools/differential_test.cpp`. Do not optimize it.
+
+Arguments
+---------
+`preprocessed` : Preprocessed trace, see `preprocess`.
+
+Returns
+-------
+`result` : Result of the template fit.
+*/
+FitResult TemplateFLT::fit_reference(const PreprocessedTrace& preprocessed) const{
+
+    // Starting sample of the segment
+    const int& sample_start_segment = preprocessed.sample_start_segment;
+
+    // Trace segment for which the correlation will be computed
+    const Eigen::ArrayXf& trace_segment = preprocessed.segment;
+
     // ID of best-fit template
-    int template_id_best;
+    int template_id_best = 0;
 
     // Index of the best desampling of the best-fit template and of template i
-    int idx_template_desampled_best, idx_template_desampled_best_i;
+    int idx_template_desampled_best = 0, idx_template_desampled_best_i = 0;
 
     // Best-fit time overall, of template i, and of desampled template j of template i
-    int t_best, t_best_i, t_best_ij;
+    int t_best = 0, t_best_i = 0, t_best_ij;
 
     // Maximum correlation of the trace with all templates, with template i, and with desampled template j of template i
     float corr_max, corr_max_i, corr_max_ij;
@@ -460,30 +1325,303 @@ void TemplateFLT::template_fit(const Eigen::ArrayXi& trace,
         }
     }
 
-    // Store the template-fit results in the object
-    this->template_id_best = template_id_best;
-    this->idx_template_desampled_best = idx_template_desampled_best;
-    this->t_peak_best = t_best + sample_start_segment + this->sample_peak_template_desampled;
-    this->corr_max_best = corr_max;
+    // Template-fit results
+    FitResult result;
+    result.template_id_best = template_id_best;
+    result.idx_template_desampled_best = idx_template_desampled_best;
+    result.t_peak_best = t_best + sample_start_segment + this->sample_peak_template_desampled;
+    result.corr_max_best = corr_max;
+    result.t_peak_fine_best = get_t_peak_fine(result.t_peak_best,result.idx_template_desampled_best,desampling_factor);
+    result.fit_complete = true;
+    result.n_templates_evaluated = templates.size();
+    result.n_saturated = preprocessed.n_saturated;
 
-    return;
+    return result;
+}
+
+
+/*
+Performs the template fit of the preprocessed trace with the packed engine.
+The trace segment is cast to float once, and the correlations of all windows of the segment
+with all desampled templates are computed in a single matrix product with `templates_packed`,
+or in one matrix product per block of `size_block` templates.
+Yields the same result as `fit_reference` up to floating-point rounding.
+Fits the preprocessed trace of `scratch`, see `preprocess`, and returns the result.
+*/
+FitResult TemplateFLT::fit_packed(FitScratch& scratch) const{
+
+    // Preprocessed trace segment for which the correlation will be computed
+    const Eigen::ArrayXf& trace_segment = scratch.preprocessed.segment;
+
+    // All windows of the segment and their RMS, one correlation value per window and template
+    Eigen::ArrayXf& rms_windows = scratch.rms_windows;
+    SegmentWindows windows = get_windows(trace_segment,templates_packed.rows(),rms_windows);
+    int n_corr = windows.cols();
+
+    // Number of packed columns per matrix product
+    int n_cols = templates_packed.cols();
+    int n_cols_block = size_block > 0 ? min(size_block*desampling_factor,n_cols) : n_cols;
+
+    // Correlations of all windows (rows) with the desampled templates of one block (columns)
+    Eigen::MatrixXf& correlations = scratch.correlations;
+    correlations.resize(n_corr,n_cols_block);
+
+    int idx_best = 0, t_best = 0;
+    float corr_max = 0;
+    for (int c_start=0; c_start<n_cols; c_start+=n_cols_block){
+        int n_cols_c = min(n_cols_block,n_cols-c_start);
+        correlations.leftCols(n_cols_c).noalias() = windows.transpose() * templates_packed.middleCols(c_start,n_cols_c);
+
+        // Scan in the order of the reference engine: template i, desampling j, window k
+        // Strict comparison such that the first maximum is kept
+        for (int c=0; c<n_cols_c; c++){
+            for (int k=0; k<n_corr; k++){
+                float corr = abs( correlations(k,c) / rms_windows(k) );
+                if (corr > corr_max){
+                    idx_best = c_start + c;
+                    t_best = k;
+                    corr_max = corr;
+                }
+            }
+        }
+    }
+
+    return make_result(idx_best,t_best,corr_max,desampling_factor,templates.size(),scratch.preprocessed);
+}
+
+
+/*
+Performs the template fit of the preprocessed trace with the anytime engine.
+The templates are evaluated one by one in the order of `template_priority`, with the packed templates.
+When the time budget is spent, the search stops and the best-so-far result is stored, with `fit_complete` = false.
+At least one template is always evaluated.
+Ties are broken in the order of the reference engine, such that a complete search yields the same
+result as `fit_packed`, whatever the priority.
+
+The templates that win most often are evaluated first: every N_FITS_PRIORITY fits,
+`template_priority` is sorted by the number of wins of each template.
+Fits the preprocessed trace of `scratch`, see `preprocess`, and returns the result.
+
+The time budget is counted from `time_arrival`, the arrival time of the trace, such that the time spent
+waiting in a buffer and preprocessing is charged to the budget. If `time_arrival` is the default time point,
+the budget is counted from the start of the fit.
+*/
+FitResult TemplateFLT::fit_anytime(FitScratch& scratch,
+                                   const chrono::steady_clock::time_point& time_arrival) const{
+    // Deadline of the fit
+    chrono::steady_clock::time_point time_start = time_arrival;
+    if (time_start == chrono::steady_clock::time_point()){
+        time_start = chrono::steady_clock::now();
+    }
+    chrono::steady_clock::time_point deadline = time_start + chrono::nanoseconds(time_budget);
+
+    // Preprocessed trace segment for which the correlation will be computed
+    const Eigen::ArrayXf& trace_segment = scratch.preprocessed.segment;
+
+    // All windows of the segment and their RMS, one correlation value per window and template
+    Eigen::ArrayXf& rms_windows = scratch.rms_windows;
+    SegmentWindows windows = get_windows(trace_segment,templates_packed.rows(),rms_windows);
+    int n_corr = windows.cols();
+
+    // Correlations of all windows (rows) with the desampled templates of one template (columns)
+    Eigen::MatrixXf& correlations = scratch.correlations;
+
+    int n_templates = templates.size();
+    int n_evaluated = 0;
+    int idx_best = 0, t_best = 0;
+    float corr_max = 0;
+    for (int p=0; p<n_templates; p++){
+        // Stop if the time budget is spent
+        if (time_budget > 0 && p > 0 && chrono::steady_clock::now() >= deadline){
+            break;
+        }
+
+        int i = scratch.template_priority[p];
+        correlations.noalias() = windows.transpose() * templates_packed.middleCols(i*desampling_factor,desampling_factor);
+
+        for (int j=0; j<desampling_factor; j++){
+            int c = i*desampling_factor + j;
+            for (int k=0; k<n_corr; k++){
+                float corr = abs( correlations(k,j) / rms_windows(k) );
+                // Same as the strict comparison of the reference engine in the order (i,j,k)
+                if (corr > corr_max || (corr == corr_max && corr > 0 && (c < idx_best || (c == idx_best && k < t_best)))){
+                    idx_best = c;
+                    t_best = k;
+                    corr_max = corr;
+                }
+            }
+        }
+        n_evaluated++;
+    }
+
+    FitResult result = make_result(idx_best,t_best,corr_max,desampling_factor,n_evaluated,scratch.preprocessed);
+
+    // Update the counters
+    scratch.budget_stats.n_fits++;
+    scratch.budget_stats.n_overruns += !result.fit_complete;
+    scratch.budget_stats.sum_completion_fraction += (double)n_evaluated / n_templates;
+
+    // Update the priority of the templates
+    vector<long>& template_wins = scratch.template_wins;
+    if (corr_max > 0){
+        template_wins[result.template_id_best]++;
+    }
+    scratch.n_fits_since_priority++;
+    if (scratch.n_fits_since_priority >= N_FITS_PRIORITY){
+        stable_sort(scratch.template_priority.begin(),scratch.template_priority.end(),
+                    [&template_wins](const int& a, const int& b){ return template_wins[a] > template_wins[b]; });
+        scratch.n_fits_since_priority = 0;
+    }
+
+    return result;
 }
 
 
 /*
-Trigger TODO
+Performs the template fit of the preprocessed trace with the polyphase engine.
+For each template, all `n_phases` desampled templates are generated on the fly from the template
+with the polyphase filter bank.
+For n_phases = desampling_factor, yields the same result as `fit_reference` up to floating-point rounding.
+Fits the preprocessed trace of `scratch`, see `preprocess`, and returns the result.
+*/
+FitResult TemplateFLT::fit_polyphase(FitScratch& scratch) const{
+
+    // Preprocessed trace segment for which the correlation will be computed
+    const Eigen::ArrayXf& trace_segment = scratch.preprocessed.segment;
+
+    int size_templ = size_template_desampled;
+
+    // All windows of the segment and their RMS, one correlation value per window and template
+    Eigen::ArrayXf& rms_windows = scratch.rms_windows;
+    SegmentWindows windows = get_windows(trace_segment,size_templ,rms_windows);
+    int n_corr = windows.cols();
+
+    int n_phases = polyphase.get_n_phases();
+
+    // All phases of one template, normalized like `templates_packed`
+    Eigen::MatrixXf& phases = scratch.phases;
+    phases.resize(size_templ,n_phases);
+    // Correlations of all windows (rows) with all phases of one template (columns)
+    Eigen::MatrixXf& correlations = scratch.correlations;
+
+    int idx_best = 0, t_best = 0;
+    float corr_max = 0;
+    for (int i=0; i<(int)templates.size(); i++){
+        // Generate all phases of template i
+        for (int p=0; p<n_phases; p++){
+            polyphase.generate(templates[i],p,phases.col(p));
+            phases.col(p) /= phases.col(p).norm() * sqrt( (float)size_templ );
+        }
+
+        correlations.noalias() = windows.transpose() * phases;
+
+        // Scan in the order of the reference engine: template i, phase p, window k
+        for (int p=0; p<n_phases; p++){
+            for (int k=0; k<n_corr; k++){
+                float corr = abs( correlations(k,p) / rms_windows(k) );
+                if (corr > corr_max){
+                    idx_best = i*n_phases + p;
+                    t_best = k;
+                    corr_max = corr;
+                }
+            }
+        }
+    }
+
+    return make_result(idx_best,t_best,corr_max,n_phases,templates.size(),scratch.preprocessed);
+}
+
+
+/*
+Trigger decision of the Template FLT-1 for a trace that was triggered by the FLT-0.
+A trace whose segment is too short to be fitted is not triggered.
+If enabled, the pre-filter is applied first, and traces that it rejects are not fitted.
+Otherwise the template fit is performed, and the trace is triggered if `corr_max_best` > the threshold,
+which is `corr_thresh` or the one given by `threshold_source` for the fit result.
+
+In verification mode of the pre-filter, the template fit is also performed for rejected traces.
+The decision remains the one of the pre-filter, but a rejected trace with `corr_max_best` > the threshold
+is counted as a false veto in the pre-filter counters.
+The subspace cut of the pre-filter is derived from `corr_thresh` (see `set_corr_thresh`), which must
+therefore not exceed the thresholds of `threshold_source`.
+
+Like the const `template_fit`, this method does not modify the object, see `make_scratch`.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`t_max` : Position of the trace maximum, determined between the "first T1 crossing" and "trigger time" of the FLT-0.
+          If < 0, it is searched within the FLT-0 window.
+
+`scratch` : Scratch of the calling thread. Also holds the counters of the pre-filter.
+
+`result` : Set to the result of the template fit. Default `FitResult` if the trace was rejected without fit,
+           or if its segment is too short to be fitted (see `template_fit`).
+           `rejected_prefilter` is set if the trace was rejected by the pre-filter.
+
+`window_flt0` : FLT-0 window {start,end} of the event in which the trace maximum is searched if `t_max` < 0,
+                end = 0 means the end of the trace. Default = the FLT-0 window of the preprocessing configuration.
+
+`time_arrival` : Arrival time of the trace, from which the time budget of the anytime fit is counted,
+                 such that the time the trace waited before the fit is charged to its budget.
+                 Default = the start of the fit.
+
+`threshold_source` : Source of the correlation threshold of the fit result, e.g. per detector unit and channel.
+                     Default = `corr_thresh` for all traces.
+
+Returns
+-------
+`decision` : True if the trace is triggered by the Template FLT-1.
 */
-bool TemplateFLT::trigger(const Eigen::ArrayXi& trace){
-    // INPUT FLT-0 PARAMETERS HERE
-    // TRIGGER TIME AND FIRST T1 CROSSING TIME
+bool TemplateFLT::trigger(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                          const int& t_max,
+                          FitScratch& scratch,
+                          FitResult& result,
+                          const Eigen::Array2i& window_flt0,
+                          const chrono::steady_clock::time_point& time_arrival,
+                          const ThresholdSource& threshold_source) const{
+    // Preprocess the trace once for the pre-filter and the template fit
+    check_scratch(scratch);
+    preprocess(trace,t_max,scratch.preprocessed,window_flt0);
+    const PreprocessedTrace& preprocessed = scratch.preprocessed;
+
+    // A segment too short to be fitted is not triggered
+    if (!is_fittable(preprocessed)){
+        result = fit_preprocessed(fit_engine,scratch,time_arrival);
+        return false;
+    }
+
+    // Apply the pre-filter
+    PreFilterConfig prefilter_config = prefilter.get_config();
+    if (prefilter_config.enabled){
+        if ( !prefilter.accept(preprocessed.segment,preprocessed.t_max-preprocessed.sample_start_segment,scratch.prefilter_stats) ){
+            if (prefilter_config.verify){
+                result = fit_preprocessed(fit_engine,scratch,time_arrival);
+                scratch.prefilter_stats.n_verified++;
+                float corr_thresh = threshold_source ? threshold_source(result) : this->corr_thresh;
+                if (result.corr_max_best > corr_thresh){
+                    scratch.prefilter_stats.n_false_vetoes++;
+                }
+            }
+            else{
+                result = FitResult();
+            }
+            result.rejected_prefilter = true;
+            return false;
+        }
+    }
 
     // Perform the template fit
-    // this->template_fit(trace,t_max)
+    result = fit_preprocessed(fit_engine,scratch,time_arrival);
+
+    // Threshold of the fit result
+    float corr_thresh = threshold_source ? threshold_source(result) : this->corr_thresh;
 
     // Decision to trigger
     bool decision;
 
-    if (this->corr_max_best > this->corr_thresh){
+    if (result.corr_max_best > corr_thresh){
         decision = true;
     }
     else{
@@ -491,4 +1629,36 @@ bool TemplateFLT::trigger(const Eigen::ArrayXi& trace){
     }
 
     return decision;
-}
\ No newline at end of file
+}
+
+
+/*
+Trigger decision of the Template FLT-1 for a trace that was triggered by the FLT-0, see the const `trigger`.
+Uses the scratch of this object. The results of the template fit are stored in the public attributes,
+unless the trace was rejected by the pre-filter without fit.
+
+Arguments
+---------
+`trace` : Input ADC trace.
+
+`t_max` : Position of the trace maximum, determined between the "first T1 crossing" and "trigger time" of the FLT-0.
+          If < 0, it is searched within the FLT-0 window.
+
+`window_flt0` : FLT-0 window of the event, see the const `template_fit`.
+
+Returns
+-------
+`decision` : True if the trace is triggered by the Template FLT-1.
+*/
+bool TemplateFLT::trigger(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                          const int& t_max,
+                          const Eigen::Array2i& window_flt0){
+    FitResult result;
+    bool decision = trigger(trace,t_max,this->scratch,result,window_flt0);
+
+    if (result.n_templates_evaluated > 0){
+        store_result(result);
+    }
+
+    return decision;
+}
@@ -29,7 +29,111 @@ by the Template FLT-1, and passed to the SLT.
 #include <vector>
 #include <string>
 #include <tuple>
+#include <chrono>
+#include <functional>
 #include <eigen3/Eigen/Dense>
+#include "prefilter.h"
+#include "polyphase.h"
+#include "preprocessing.h"
+#include "autotune.h"
+
+/*
+-----
+ENUMS
+-----
+*/
+
+// Correlation engines that can perform the template fit
+// REFERENCE = frozen reference implementation, all other engines are validated against it
+// PACKED = all desampled templates packed in one matrix, correlations computed as a single matrix product
+//          (or one product per block of templates, see `set_size_block`)
+// ANYTIME = packed templates evaluated in priority order until the time budget is spent, see `set_time_budget`
+// POLYPHASE = desampled templates generated on the fly with a polyphase filter bank, see `set_n_phases`
+enum class FitEngine{
+    REFERENCE,
+    PACKED,
+    ANYTIME,
+    POLYPHASE
+};
+
+/*
+-------
+STRUCTS
+-------
+*/
+
+// Counters of the anytime fit
+struct BudgetStats{
+    // Number of anytime fits
+    long n_fits = 0;
+    // Number of fits that ran out of time budget before all templates were evaluated
+    long n_overruns = 0;
+    // Sum over all fits of the fraction of templates that was evaluated
+    double sum_completion_fraction = 0;
+};
+
+// Result of a template fit
+struct FitResult{
+    // ID of best-fit template
+    int template_id_best = 0;
+    // Index of the best desampling (phase for the polyphase engine) of the best-fit template
+    int idx_template_desampled_best = 0;
+    // Best-fit time of the pulse peak
+    int t_peak_best = 0;
+    // Maximum correlation yielding the best-fit template
+    float corr_max_best = 0;
+    // Best-fit time of the pulse peak with sub-sample resolution, from the phase of the best-fit template
+    float t_peak_fine_best = 0;
+    // Whether all templates were evaluated (always true except for the anytime fit)
+    bool fit_complete = false;
+    // Number of templates evaluated, 0 if the trace was not fitted
+    int n_templates_evaluated = 0;
+    // Whether the trace was rejected by the pre-filter of `TemplateFLT::trigger` (fitted anyway in verification mode)
+    bool rejected_prefilter = false;
+    // Number of saturated samples of the trace (flag of a saturated trace), see `PreprocessConfig::saturation_level`
+    int n_saturated = 0;
+};
+
+// Source of the correlation threshold of `TemplateFLT::trigger` for a fit result,
+// e.g. the per-unit thresholds of the decision stage (see `decision.h`)
+typedef std::function<float(const FitResult&)> ThresholdSource;
+
+// Mutable state of the template fit, provided by the caller of the const `TemplateFLT::template_fit`
+// A scratch belongs to one TemplateFLT object and must not be used by two fits at the same time:
+// each thread that shares a TemplateFLT object needs its own scratch, see `TemplateFLT::make_scratch`
+struct FitScratch{
+    // Preprocessed trace of the last fit
+    PreprocessedTrace preprocessed;
+
+    // Buffers of the correlation engines, reused between fits
+    Eigen::ArrayXf rms_windows;
+    Eigen::MatrixXf correlations;
+    Eigen::MatrixXf phases;
+
+    // Order in which the anytime fit evaluates the templates
+    std::vector<int> template_priority;
+    // Number of times each template was the best-fit template of the anytime fit
+    std::vector<long> template_wins;
+    // Number of anytime fits since `template_priority` was last sorted by `template_wins`
+    int n_fits_since_priority = 0;
+    // Counters of the anytime fit
+    BudgetStats budget_stats;
+
+    // Counters of the pre-filter
+    PreFilterStats prefilter_stats;
+};
+
+/*
+---------
+FUNCTIONS
+---------
+*/
+
+std::vector<FitEngine> get_fit_engines();
+
+std::string fit_engine_name(const FitEngine& fit_engine);
+
+FitEngine fit_engine_from_name(const std::string& name);
 
 class TemplateFLT{
     private:
@@ -60,15 +164,74 @@ class TemplateFLT{
         // Threshold for the correlation value in order to trigger
         float corr_thresh;
 
+        // Correlation engine used by `template_fit`
+        FitEngine fit_engine;
+        // Desampled templates normalized to RMS*size = 1, packed column-wise (column = i*desampling_factor+j)
+        Eigen::MatrixXf templates_packed;
+        // Number of templates per matrix product of the packed engine, 0 = all templates
+        int size_block;
+
+        // Configuration of the autotuner that selects the fastest engine, see `autotune`
+        AutotuneConfig autotune_config;
+        // Decision of the last run of the autotuner
+        AutotuneResult autotune_result;
+
+        // Configuration of the fused preprocessing
+        PreprocessConfig preprocess_config;
+
+        // Pre-filter stage in front of the template fit in `trigger`
+        PreFilter prefilter;
+
+        // Time budget of the anytime fit [ns], 0 = unlimited
+        long time_budget;
+        // Initial order in which the anytime fit evaluates the templates, copied into each scratch
+        std::vector<int> template_priority;
+
+        // Number of phases of the polyphase engine, 0 = desampling factor
+        int n_phases;
+        // Number of taps of the polyphase interpolation filters
+        int n_taps;
+        // Polyphase filter bank that generates the desampled templates of the polyphase engine
+        PolyphaseFilterBank polyphase;
+
+        // Scratch of the non-const fit methods, whose results are stored in the public attributes
+        FitScratch scratch;
+
         /*
         ---------------
         PRIVATE METHODS
         ---------------
         */
 
-        std::tuple<int,float> compute_max_correlation(const Eigen::ArrayXi& trace,
+        std::tuple<int,float> compute_max_correlation(const Eigen::ArrayXf& trace,
                                                       const Eigen::ArrayXf& templ,
-                                                      const bool& norm=true);
+                                                      const bool& norm=true) const;
+        void get_segment_bounds(const int& size_trace,
+                                const int& t_max,
+                                int& sample_start_segment,
+                                int& size_segment) const;
+        bool is_fittable(const PreprocessedTrace& preprocessed) const;
+        void check_scratch(FitScratch& scratch) const;
+        FitResult fit_preprocessed(const FitEngine& fit_engine,
+                                   FitScratch& scratch,
+                                   const std::chrono::steady_clock::time_point& time_arrival) const;
+        FitResult fit_reference(const PreprocessedTrace& preprocessed) const;
+        FitResult fit_packed(FitScratch& scratch) const;
+        FitResult fit_anytime(FitScratch& scratch,
+                              const std::chrono::steady_clock::time_point& time_arrival) const;
+        FitResult fit_polyphase(FitScratch& scratch) const;
+        FitResult make_result(const int& idx_best,
+                              const int& t_best,
+                              const float& corr_max,
+                              const int& n_phases,
+                              const int& n_evaluated,
+                              const PreprocessedTrace& preprocessed) const;
+        void store_result(const FitResult& result);
+        std::string get_autotune_key() const;
+        void pack_templates();
+        float get_t_peak_fine(const int& t_peak,
+                              const int& idx_phase,
+                              const int& n_phases) const;
 
     public:
         /*
@@ -82,6 +245,7 @@ class TemplateFLT{
         // Templates desampled to `adc_sampling_rate`
         std::vector< std::vector< Eigen::ArrayXf > > templates_desampled;
 
+        // Results of the last fit of the non-const fit methods, see `FitResult`
         // ID of best-fit template
         int template_id_best;
         // Index of the best desampling of the best-fit template
@@ -90,6 +254,14 @@ class TemplateFLT{
         int t_peak_best;
         // Maximum correlation yielding the best-fit template
         float corr_max_best;
+        // Best-fit time of the pulse peak with sub-sample resolution, from the phase of the best-fit template
+        float t_peak_fine_best;
+        // Whether all templates were evaluated (always true except for the anytime fit)
+        bool fit_complete;
+        // Number of templates evaluated
+        int n_templates_evaluated;
+        // Number of saturated samples of the trace
+        int n_saturated;
 
         /*
         ------------
@@ -117,6 +289,15 @@ class TemplateFLT{
         void set_corr_window(const int& start,
                              const int& end);
         void set_corr_thresh(const float& corr_thresh);
+        void set_fit_engine(const FitEngine& fit_engine);
+        void set_size_block(const int& size_block);
+        void set_autotune_config(const AutotuneConfig& autotune_config);
+        void set_prefilter_config(const PreFilterConfig& prefilter_config);
+        void set_preprocess_config(const PreprocessConfig& preprocess_config);
+        void set_time_budget(const long& time_budget);
+        void set_template_priority(const std::vector<int>& template_priority);
+        void set_n_phases(const int& n_phases,
+                          const int& n_taps = 16);
 
         /*
         -------
@@ -124,15 +305,27 @@ class TemplateFLT{
         -------
         */
 
-        int get_adc_sampling_rate();
-        int get_sim_sampling_rate();
-        int get_desampling_factor();
-        int get_size_template();
-        int get_size_template_desampled();
-        int get_sample_peak_template();
-        int get_sample_peak_template_desampled();
-        Eigen::Array2i get_corr_window();
-        float get_corr_thresh();
+        int get_adc_sampling_rate() const;
+        int get_sim_sampling_rate() const;
+        int get_desampling_factor() const;
+        int get_size_template() const;
+        int get_size_template_desampled() const;
+        int get_sample_peak_template() const;
+        int get_sample_peak_template_desampled() const;
+        Eigen::Array2i get_corr_window() const;
+        float get_corr_thresh() const;
+        FitEngine get_fit_engine() const;
+        int get_size_block() const;
+        AutotuneConfig get_autotune_config() const;
+        AutotuneResult get_autotune_result() const;
+        PreFilterConfig get_prefilter_config() const;
+        PreFilterStats get_prefilter_stats() const;
+        PreprocessConfig get_preprocess_config() const;
+        long get_time_budget() const;
+        std::vector<int> get_template_priority() const;
+        BudgetStats get_budget_stats() const;
+        int get_n_phases() const;
+        PreprocessedTrace get_preprocessed() const;
 
         /*
         --------------
@@ -144,8 +337,33 @@ class TemplateFLT{
                             const int& size_template = 400,
                             const int& sample_peak_template = 120);
         void desample_templates();
-        void template_fit(const Eigen::ArrayXi& trace,
-                          const int& t_max);
-        bool trigger(const Eigen::ArrayXi& trace);
+        AutotuneResult autotune();
+        FitScratch make_scratch() const;
+        void preprocess(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                        const int& t_max,
+                        PreprocessedTrace& preprocessed,
+                        const Eigen::Array2i& window_flt0 = WINDOW_FLT0_DEFAULT) const;
+        FitResult template_fit(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                               const int& t_max,
+                               FitScratch& scratch,
+                               const Eigen::Array2i& window_flt0 = WINDOW_FLT0_DEFAULT,
+                               const std::chrono::steady_clock::time_point& time_arrival = {}) const;
+        void template_fit(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                          const int& t_max,
+                          const Eigen::Array2i& window_flt0 = WINDOW_FLT0_DEFAULT);
+        void template_fit(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                          const int& t_max,
+                          const FitEngine& fit_engine,
+                          const Eigen::Array2i& window_flt0 = WINDOW_FLT0_DEFAULT);
+        bool trigger(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                     const int& t_max,
+                     FitScratch& scratch,
+                     FitResult& result,
+                     const Eigen::Array2i& window_flt0 = WINDOW_FLT0_DEFAULT,
+                     const std::chrono::steady_clock::time_point& time_arrival = {},
+                     const ThresholdSource& threshold_source = nullptr) const;
+        bool trigger(const Eigen::Ref<const Eigen::ArrayXi>& trace,
+                     const int& t_max,
+                     const Eigen::Array2i& window_flt0 = WINDOW_FLT0_DEFAULT);
 };
 # endif // TEMPLATE_FLT_H
\ No newline at end of file
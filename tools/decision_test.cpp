@@ -0,0 +1,348 @@
+/*
+////////////////////////////////////
+//** DECISION TEST SOURCE FILE ** //
+////////////////////////////////////
+
+Test of the decision stage (see `decision.h`):
+- batch decisions: `decide_batch` and `DecisionStage::decide` on a batch must agree with the decision of each
+  fit result, with per-unit, per-channel and per-group thresholds; traces that were not fitted or rejected by
+  the pre-filter are never triggered,
+- invalid tables and fit results are rejected: negative template groups, entries out of range,
+  thresholds outside [0,1],
+- updates: `set_threshold` and `load_thresholds` publish a new version of the table that changes only the
+  selected entries, while snapshots taken before keep the previous thresholds,
+- concurrent updates: while a monitoring thread alternates between two uniform tables, decider threads
+  decide batches whose correlation lies between both thresholds, and every batch must be decided with one
+  table, i.e. all decisions of a batch must be equal.
+
+The threshold file is written to a temporary directory, which is removed at the end.
+
+Build from the repository root:
+    g++ -O3 -pthread tools/decision_test.cpp decision.cpp error_handling.cpp -o decision_test
+
+Usage:
+    ./decision_test
+
+Returns 0 if all checks pass, 1 otherwise.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <stdlib.h>
+#include "../decision.h"
+
+using namespace std;
+
+// Number of failed checks
+int N_FAILED = 0;
+
+/*
+Prints the outcome of a check and counts it if it failed.
+*/
+void check(const bool& passed,
+           const string& description){
+    cout << (passed ? "    ok: " : "FAILED: ") << description << endl;
+    N_FAILED += !passed;
+}
+
+
+/*
+Returns a fit result with a best-fit template and correlation.
+*/
+FitResult make_result(const int& template_id,
+                      const float& corr_max){
+    FitResult result;
+    result.template_id_best = template_id;
+    result.corr_max_best = corr_max;
+    result.n_templates_evaluated = 1;
+    result.fit_complete = true;
+
+    return result;
+}
+
+
+/*
+Returns a table of 3 units, 2 channels and 2 groups of 4 templates,
+with threshold 0.1*(unit+1) + 0.05*channel + 0.02*group.
+*/
+ThresholdTable make_test_table(){
+    ThresholdTable table = make_threshold_table(3,2,0,{0,0,1,1});
+    for (int unit=0; unit<3; unit++){
+        for (int channel=0; channel<2; channel++){
+            for (int group=0; group<2; group++){
+                table.thresholds( (unit*2 + channel)*2 + group ) = 0.1*(unit+1) + 0.05*channel + 0.02*group;
+            }
+        }
+    }
+
+    return table;
+}
+
+
+void test_decide(){
+    cout << "*** Batch decisions ***" << endl;
+
+    DecisionStage decision_stage( make_test_table() );
+    shared_ptr<const ThresholdTable> table = decision_stage.get_table();
+
+    // All entries of the table, with a correlation just below and just above the threshold
+    DecisionBatch batch;
+    vector<bool> decisions_single;
+    for (int unit=0; unit<3; unit++){
+        for (int channel=0; channel<2; channel++){
+            for (int template_id=0; template_id<4; template_id++){
+                float corr_thresh = get_threshold(*table,unit,channel,template_id);
+                for (float corr_max : {corr_thresh-0.01f,corr_thresh+0.01f}){
+                    add_to_batch(batch,unit,channel,make_result(template_id,corr_max));
+                    decisions_single.push_back( decision_stage.decide(unit,channel,template_id,corr_max) );
+                }
+            }
+        }
+    }
+
+    ArrayXb decisions, decisions_stage;
+    int n_triggered = decide_batch(*table,batch,decisions);
+    int n_triggered_stage = decision_stage.decide(batch,decisions_stage);
+
+    bool agree = decisions.size() == (int)decisions_single.size();
+    for (int i=0; agree && i<decisions.size(); i++){
+        agree = decisions(i) == decisions_single[i] && decisions(i) == (i % 2 == 1);
+    }
+    check(agree,"batch decisions agree with the single decisions and the thresholds of the table");
+    check(n_triggered == (int)decisions_single.size()/2 && n_triggered_stage == n_triggered
+          && (decisions_stage == decisions).all(),"decide_batch and DecisionStage::decide agree");
+    check(get_threshold(*table,2,1,3) == table->thresholds(11),"threshold of the last unit, channel and group");
+
+    // Traces that were not fitted or rejected by the pre-filter are not triggered, whatever their correlation
+    clear_batch(batch);
+    check(batch.units.empty() && batch.corr_max.empty(),"clear_batch empties the batch");
+    FitResult result_rejected = make_result(3,1);
+    result_rejected.rejected_prefilter = true;
+    FitResult result_not_fitted = make_result(3,1);
+    result_not_fitted.n_templates_evaluated = 0;
+    add_to_batch(batch,0,0,result_rejected);
+    add_to_batch(batch,0,1,result_not_fitted);
+    add_to_batch(batch,0,0,make_result(3,1));
+    decide_batch(*table,batch,decisions);
+    check(!decisions(0) && !decisions(1) && decisions(2),"rejected and not fitted traces are not triggered");
+
+    // Without template groups, all templates share the threshold of group 0
+    ThresholdTable table_ungrouped = make_threshold_table(1,2,0.5);
+    clear_batch(batch);
+    add_to_batch(batch,0,1,make_result(95,0.6));
+    add_to_batch(batch,0,1,make_result(0,0.4));
+    decide_batch(table_ungrouped,batch,decisions);
+    check(table_ungrouped.n_groups == 1 && decisions(0) && !decisions(1),"table without template groups");
+}
+
+
+void test_invalid(){
+    cout << "*** Invalid tables and fit results ***" << endl;
+
+    bool thrown = false;
+    try{
+        make_threshold_table(2,2,0.5,{0,-1,1});
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown,"negative template group rejected");
+
+    thrown = false;
+    try{
+        make_threshold_table(0,2,0.5);
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown,"0 units rejected");
+
+    thrown = false;
+    try{
+        DecisionStage decision_stage( make_threshold_table(2,2,1.5) );
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown,"threshold > 1 rejected");
+
+    DecisionStage decision_stage( make_test_table() );
+
+    thrown = false;
+    try{
+        decision_stage.set_threshold(0,0,2,0.5);
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown,"set_threshold of a group out of range rejected");
+
+    const vector< array<int,3> > entries_invalid = {{3,0,0},{0,2,0},{0,0,4},{-1,0,0},{0,0,-1}};
+    bool thrown_all = true;
+    for (const array<int,3>& entry : entries_invalid){
+        DecisionBatch batch;
+        add_to_batch(batch,entry[0],entry[1],make_result(entry[2],0.5));
+        ArrayXb decisions;
+        thrown = false;
+        try{
+            decision_stage.decide(batch,decisions);
+        }
+        catch (const runtime_error& err){
+            thrown = true;
+        }
+        thrown_all = thrown_all && thrown;
+    }
+    check(thrown_all,"fit results with unit, channel or template ID out of range rejected");
+}
+
+
+void test_update(const string& dir){
+    cout << "*** Threshold updates ***" << endl;
+
+    DecisionStage decision_stage( make_test_table() );
+    shared_ptr<const ThresholdTable> table_before = decision_stage.get_table();
+
+    // One entry
+    decision_stage.set_threshold(1,0,1,0.9);
+    shared_ptr<const ThresholdTable> table = decision_stage.get_table();
+    check(table->version == table_before->version + 1,"set_threshold publishes a new version");
+    check(get_threshold(*table,1,0,2) == 0.9f && get_threshold(*table,1,0,0) == get_threshold(*table_before,1,0,0),
+          "set_threshold changes only the selected entry");
+    check(!decision_stage.decide(1,0,2,0.85) && decision_stage.decide(1,0,0,0.85),"decisions use the new threshold");
+    check(get_threshold(*table_before,1,0,2) == make_test_table().thresholds(5),"previous snapshot unchanged");
+
+    // Threshold file: all channels and groups of unit 2, then channel 1 of all units and group 0
+    string threshold_file_name = dir + "/thresholds.txt";
+    ofstream threshold_file(threshold_file_name);
+    threshold_file << "# unit channel group corr_thresh" << endl;
+    threshold_file << "2 -1 -1 0.8" << endl;
+    threshold_file << endl;
+    threshold_file << "-1 1 0 0.7" << endl;
+    threshold_file.close();
+
+    decision_stage.load_thresholds(threshold_file_name);
+    shared_ptr<const ThresholdTable> table_loaded = decision_stage.get_table();
+    check(table_loaded->version == table->version + 1,"load_thresholds publishes one new version");
+    check(get_threshold(*table_loaded,2,0,0) == 0.8f && get_threshold(*table_loaded,2,0,3) == 0.8f
+          && get_threshold(*table_loaded,2,1,3) == 0.8f,"wildcard channel and group");
+    check(get_threshold(*table_loaded,0,1,0) == 0.7f && get_threshold(*table_loaded,2,1,0) == 0.7f
+          && get_threshold(*table_loaded,1,1,0) == 0.7f,"wildcard unit, later lines override earlier ones");
+    check(get_threshold(*table_loaded,0,0,0) == get_threshold(*table,0,0,0) && get_threshold(*table_loaded,1,0,2) == 0.9f
+          && get_threshold(*table_loaded,0,1,2) == get_threshold(*table,0,1,2),"entries not in the file unchanged");
+
+    // An invalid line rejects the whole file
+    threshold_file.open(threshold_file_name);
+    threshold_file << "0 0 0 0.3" << endl;
+    threshold_file << "0 0 0 1.3" << endl;
+    threshold_file.close();
+    bool thrown = false;
+    try{
+        decision_stage.load_thresholds(threshold_file_name);
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown && decision_stage.get_table() == table_loaded,"invalid threshold file rejected without update");
+
+    thrown = false;
+    try{
+        decision_stage.load_thresholds(dir + "/missing.txt");
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown,"missing threshold file rejected");
+}
+
+
+void test_concurrent_update(){
+    cout << "*** Concurrent updates ***" << endl;
+
+    const int n_deciders = 4;
+    const int n_batches = 2000;
+    const int size_batch = 64;
+    const int n_units = 8;
+
+    ThresholdTable table_low = make_threshold_table(n_units,2,0.2);
+    ThresholdTable table_high = make_threshold_table(n_units,2,0.8);
+    DecisionStage decision_stage(table_low);
+
+    // Batch over all units and channels with a correlation between both thresholds
+    DecisionBatch batch;
+    for (int i=0; i<size_batch; i++){
+        add_to_batch(batch,i % n_units,(i / n_units) % 2,make_result(i,0.5));
+    }
+
+    // Monitoring thread: alternates between both tables until the deciders are done
+    atomic<bool> done(false);
+    long n_updates = 0;
+    thread updater([&](){
+        while (!done.load()){
+            decision_stage.set_table( n_updates % 2 == 0 ? table_high : table_low );
+            n_updates++;
+            this_thread::yield();
+        }
+    });
+
+    // Decider threads: every batch must be decided with one table
+    atomic<long> n_mixed(0), n_all_triggered(0), n_none_triggered(0);
+    vector<thread> deciders;
+    for (int d=0; d<n_deciders; d++){
+        deciders.emplace_back([&](){
+            ArrayXb decisions;
+            for (int b=0; b<n_batches; b++){
+                int n_triggered = decision_stage.decide(batch,decisions);
+                if (n_triggered == size_batch){
+                    n_all_triggered++;
+                }
+                else if (n_triggered == 0){
+                    n_none_triggered++;
+                }
+                else{
+                    n_mixed++;
+                }
+                // Let the monitoring thread run between the batches, also on a single core
+                this_thread::yield();
+            }
+        });
+    }
+    for (thread& t : deciders){
+        t.join();
+    }
+    done = true;
+    updater.join();
+
+    cout << "    " << n_updates << " updates, " << n_all_triggered << " batches with the low table, "
+         << n_none_triggered << " with the high table" << endl;
+    check(n_mixed == 0,"no batch decided with two tables");
+    check(n_all_triggered + n_none_triggered == n_deciders*n_batches,"all batches decided");
+    check(decision_stage.get_table()->version == n_updates,"one version per update");
+}
+
+
+int main(){
+    char dir_template[] = "/tmp/decision_test.XXXXXX";
+    char* dir = mkdtemp(dir_template);
+    if (!dir){
+        cerr << "Error creating temporary directory" << endl;
+        return 1;
+    }
+
+    test_decide();
+    test_invalid();
+    test_update(dir);
+    test_concurrent_update();
+
+    // Remove the temporary directory
+    string command = "rm -rf " + string(dir);
+    if (system( command.c_str() ) != 0){
+        cerr << "Error removing " << dir << endl;
+    }
+
+    cout << endl << (N_FAILED == 0 ? "PASSED" : "FAILED") << ": decision test" << endl;
+
+    return N_FAILED == 0 ? 0 : 1;
+}
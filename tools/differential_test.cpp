@@ -0,0 +1,582 @@
+/*
+////////////////////////////////////////
+//** DIFFERENTIAL TEST SOURCE FILE ** //
+////////////////////////////////////////
+
+Randomized differential test of all correlation engines of the Template FLT-1.
+
+For each template library, random traces are generated by injecting a random template of the library
+with a random phase, amplitude, peak position and pedestal offset into Gaussian noise.
+A fraction of the peaks is injected near the edges of the trace, where the trace segment is patched.
+The template fit of every engine, and of the packed engine with the block sizes SIZE_BLOCKS,
+is compared to the one of the reference engine on the same traces, and every engine is timed on the same traces.
+
+An engine agrees with the reference if:
+- the patched segment of a peak near the edges is shorter than a template, and both report the trace
+  as not fitted (`n_templates_evaluated` = 0), or
+- `template_id_best`, `idx_template_desampled_best` and `t_peak_best` are identical and
+  `corr_max_best` agrees within CORR_TOL, or
+- the best-fit parameters differ, but `corr_max_best` agrees within CORR_TOL (near-degenerate fit),
+  and the correlation of the reported template, desampling and `t_peak_best` recomputed with the
+  correlation of the reference engine reproduces `corr_max_best` within CORR_TOL.
+An engine that throws an error, or that fits a trace whose segment is shorter than a template (or vice versa),
+disagrees with the reference.
+
+The polyphase engine is also run with finer phase resolutions (N_PHASES_FACTORS*desampling_factor phases).
+These phases include the ones of the reference, so `corr_max_best` must be at least the one of the reference
+within CORR_TOL.
+
+Every engine is run with the const `template_fit` on one TemplateFLT shared by N_THREADS_SHARED threads,
+each with its own scratch. The results must be identical to the ones of the single-threaded run.
+
+All engines are then compared to the reference again with the preprocessing enabled (see `preprocessing.h`):
+the pedestal is subtracted, the trace maximum is searched in the preprocessing pass, and the saturated samples
+are counted. Every other trace is given its own FLT-0 window of SIZE_WINDOW_FLT0 samples around its maximum,
+in which the maximum must be found; the others are searched in the default window (the whole trace).
+Every engine must report the number of saturated samples of the trace.
+
+Finally, `trigger` is run with the pre-filter in verification mode, with the subspace cut of N_COMPONENTS_PREFILTER
+principal components derived from each threshold of CORR_THRESHS_PREFILTER (see `prefilter.h`).
+The pre-filter must never veto a trace that the full fit accepts: `n_false_vetoes` must be 0.
+
+Build from the repository root:
+    g++ -O3 -pthread tools/differential_test.cpp template_FLT.cpp prefilter.cpp polyphase.cpp preprocessing.cpp autotune.cpp trace_generator.cpp utils.cpp error_handling.cpp -o differential_test
+
+Usage:
+    ./differential_test [n_traces] [seed] [template_file ...]
+
+Returns 0 if all engines agree with the reference on all traces, 1 otherwise.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include "../template_FLT.h"
+#include "../trace_generator.h"
+#include "../utils.h"
+
+using namespace std;
+
+// Number of samples of a trace
+int SIZE_TRACE = 1024;
+// Absolute tolerance on `corr_max_best`
+float CORR_TOL = 1e-4;
+// Fraction of traces with a peak injected near the edges of the trace
+float FRAC_EDGE = 0.2;
+// Number of samples from the trace edges considered as "near the edge"
+int SIZE_EDGE = 80;
+// Finer phase resolutions of the polyphase engine, in units of the desampling factor
+vector<int> N_PHASES_FACTORS = {2,4};
+// Number of threads sharing one TemplateFLT
+int N_THREADS_SHARED = 4;
+// Block sizes of the packed engine, in number of templates
+vector<int> SIZE_BLOCKS = {1,4,16};
+// Correlation thresholds from which the subspace cut of the pre-filter is derived
+vector<float> CORR_THRESHS_PREFILTER = {0.5,0.7,0.9};
+// Number of principal components of the subspace cut of the pre-filter
+int N_COMPONENTS_PREFILTER = 16;
+// Number of baseline samples of the pedestal and ADC saturation level of the preprocessing
+int SIZE_BASELINE_PREPROCESS = 64;
+int SATURATION_LEVEL_PREPROCESS = 100;
+// Number of samples of the FLT-0 window of a trace in which the trace maximum is searched
+int SIZE_WINDOW_FLT0 = 64;
+
+vector<string> TEMPLATE_FILES = {"templates_3_XY_rfv2.txt",
+                                 "templates_5_XY_rfv2.txt",
+                                 "templates_10_XY_rfv2.txt",
+                                 "templates_96_XY_rfv2.txt"};
+
+/*
+Correlation engine with its block size.
+*/
+struct EngineVariant{
+    string name;
+    FitEngine fit_engine;
+    int size_block;
+};
+
+
+/*
+Result of one template fit.
+*/
+struct FitOutcome{
+    bool error = false;
+    bool fitted = false;
+    int template_id_best = -1;
+    int idx_template_desampled_best = -1;
+    int t_peak_best = -1;
+    float corr_max_best = 0;
+    int n_saturated = 0;
+};
+
+
+/*
+Recomputes the correlation of the best-fit template, desampling and time of a fit outcome
+with the correlation of the reference engine, on the preprocessed trace segment.
+
+Returns -1 if the best-fit time does not lie within the trace segment.
+*/
+float reference_correlation(const TemplateFLT& flt,
+                            const Eigen::ArrayXi& trace,
+                            const int& t_max,
+                            const Eigen::Array2i& window_flt0,
+                            const FitOutcome& outcome){
+    PreprocessedTrace preprocessed;
+    flt.preprocess(trace,t_max,preprocessed,window_flt0);
+
+    const Eigen::ArrayXf& templ = flt.templates_desampled[outcome.template_id_best][outcome.idx_template_desampled_best];
+
+    // Start of the best-fit window in the segment
+    int k = outcome.t_peak_best - flt.get_sample_peak_template_desampled() - preprocessed.sample_start_segment;
+    if (k < 0 || k + templ.size() > preprocessed.segment.size()){
+        return -1;
+    }
+
+    Eigen::ArrayXf window = preprocessed.segment.segment(k,templ.size());
+
+    return abs( correlate(window,templ,true)(0) );
+}
+
+
+/*
+Runs the template fit of the currently selected engine of `flt` on all traces.
+
+Returns the elapsed time [s].
+*/
+double run_engine(TemplateFLT& flt,
+                  const vector<Eigen::ArrayXi>& traces,
+                  const vector<int>& t_maxs,
+                  const vector<Eigen::Array2i>& windows_flt0,
+                  vector<FitOutcome>& outcomes){
+    outcomes.assign(traces.size(),FitOutcome());
+
+    auto start = chrono::steady_clock::now();
+    for (size_t n=0; n<traces.size(); n++){
+        try{
+            flt.template_fit(traces[n],t_maxs[n],windows_flt0[n]);
+            outcomes[n].fitted = flt.n_templates_evaluated > 0;
+            outcomes[n].template_id_best = flt.template_id_best;
+            outcomes[n].idx_template_desampled_best = flt.idx_template_desampled_best;
+            outcomes[n].t_peak_best = flt.t_peak_best;
+            outcomes[n].corr_max_best = flt.corr_max_best;
+            outcomes[n].n_saturated = flt.n_saturated;
+        }
+        catch (const runtime_error& err){
+            outcomes[n].error = true;
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    return chrono::duration<double>(end-start).count();
+}
+
+
+/*
+Runs the template fit of the currently selected engine of `flt` on all traces with the const `template_fit`,
+from `n_threads` threads that share `flt`. Thread t fits the traces t, t+n_threads, ...
+*/
+void run_engine_shared(const TemplateFLT& flt,
+                       const vector<Eigen::ArrayXi>& traces,
+                       const vector<int>& t_maxs,
+                       const int& n_threads,
+                       vector<FitOutcome>& outcomes){
+    outcomes.assign(traces.size(),FitOutcome());
+
+    vector<thread> threads;
+    for (int t=0; t<n_threads; t++){
+        threads.emplace_back([&,t](){
+            FitScratch scratch = flt.make_scratch();
+            for (size_t n=t; n<traces.size(); n+=n_threads){
+                try{
+                    FitResult result = flt.template_fit(traces[n],t_maxs[n],scratch);
+                    outcomes[n].fitted = result.n_templates_evaluated > 0;
+                    outcomes[n].template_id_best = result.template_id_best;
+                    outcomes[n].idx_template_desampled_best = result.idx_template_desampled_best;
+                    outcomes[n].t_peak_best = result.t_peak_best;
+                    outcomes[n].corr_max_best = result.corr_max_best;
+                }
+                catch (const runtime_error& err){
+                    outcomes[n].error = true;
+                }
+            }
+        });
+    }
+    for (thread& t : threads){
+        t.join();
+    }
+
+    return;
+}
+
+
+/*
+Checks for each trace whether its preprocessed segment is at least as long as a desampled template,
+i.e. whether the trace must be fitted by all engines.
+*/
+vector<bool> get_fittable(const TemplateFLT& flt,
+                          const vector<Eigen::ArrayXi>& traces,
+                          const vector<int>& t_maxs,
+                          const vector<Eigen::Array2i>& windows_flt0){
+    vector<bool> fittable(traces.size());
+
+    PreprocessedTrace preprocessed;
+    for (size_t n=0; n<traces.size(); n++){
+        flt.preprocess(traces[n],t_maxs[n],preprocessed,windows_flt0[n]);
+        fittable[n] = preprocessed.segment.size() >= flt.get_size_template_desampled();
+    }
+
+    return fittable;
+}
+
+
+/*
+Compares the template fits of all engine variants to the ones of the reference engine (variant 0),
+and prints one row per variant.
+
+Returns the number of variants that disagree with the reference.
+*/
+int compare_engines(const TemplateFLT& flt,
+                    const vector<Eigen::ArrayXi>& traces,
+                    const vector<int>& t_maxs,
+                    const vector<Eigen::Array2i>& windows_flt0,
+                    const vector<EngineVariant>& variants,
+                    const vector< vector<FitOutcome> >& outcomes,
+                    const vector<double>& times){
+    cout << setw(12) << "engine" << setw(12) << "us/fit" << setw(10) << "speedup"
+         << setw(12) << "not fitted" << setw(12) << "near-ties" << setw(12) << "mismatches" << setw(14) << "max |dcorr|" << endl;
+
+    vector<bool> fittable = get_fittable(flt,traces,t_maxs,windows_flt0);
+
+    int n_failed = 0;
+    for (size_t e=0; e<variants.size(); e++){
+        int n_not_fitted = 0, n_near_ties = 0, n_mismatches = 0;
+        float dcorr_max = 0;
+
+        for (size_t n=0; n<traces.size(); n++){
+            const FitOutcome& ref = outcomes[0][n];
+            const FitOutcome& out = outcomes[e][n];
+
+            // Traces that are too close to the edges must not be fitted by any engine
+            if (out.error || ref.error || out.fitted != fittable[n] || ref.fitted != fittable[n]){
+                n_mismatches++;
+                continue;
+            }
+            if (!fittable[n]){
+                n_not_fitted++;
+                continue;
+            }
+
+            float dcorr = abs(out.corr_max_best - ref.corr_max_best);
+            dcorr_max = max(dcorr,dcorr_max);
+
+            bool same_fit = out.template_id_best == ref.template_id_best
+                            && out.idx_template_desampled_best == ref.idx_template_desampled_best
+                            && out.t_peak_best == ref.t_peak_best;
+
+            if (dcorr > CORR_TOL){
+                n_mismatches++;
+            }
+            else if (!same_fit){
+                // A near tie only agrees if the reported fit reproduces its correlation
+                float corr = reference_correlation(flt,traces[n],t_maxs[n],windows_flt0[n],out);
+                if (abs(corr - out.corr_max_best) > CORR_TOL){
+                    n_mismatches++;
+                }
+                else{
+                    n_near_ties++;
+                }
+            }
+        }
+
+        if (n_mismatches > 0){
+            n_failed++;
+        }
+
+        cout << setw(12) << variants[e].name
+             << setw(12) << fixed << setprecision(2) << 1e6*times[e]/traces.size()
+             << setw(10) << setprecision(2) << times[0]/times[e]
+             << setw(12) << n_not_fitted
+             << setw(12) << n_near_ties
+             << setw(12) << n_mismatches
+             << setw(14) << scientific << setprecision(2) << dcorr_max << endl;
+        cout.unsetf(ios::floatfield);
+    }
+
+    return n_failed;
+}
+
+
+/*
+Runs the differential test for one template library.
+
+Returns the number of traces for which an engine disagrees with the reference.
+*/
+int test_template_file(const string& template_file,
+                       const int& n_traces,
+                       const unsigned int& seed){
+    TemplateFLT flt(template_file);
+    TraceGenerator generator(seed);
+
+    int desampling_factor = flt.get_desampling_factor();
+    int sample_peak_template = flt.get_sample_peak_template();
+
+    // Generate the random traces
+    vector<Eigen::ArrayXi> traces;
+    vector<int> t_maxs;
+    for (int n=0; n<n_traces; n++){
+        float sigma = generator.uniform(1,10);
+        float offset = generator.uniform(-20,20);
+        Eigen::ArrayXf trace = generator.noise(SIZE_TRACE,sigma,offset);
+
+        int template_id = generator.uniform_int(0,flt.templates.size()-1);
+        int idx_desampled = generator.uniform_int(0,desampling_factor-1);
+        float amplitude = generator.uniform(0,20*sigma);
+        if (generator.uniform(0,1) < 0.5){
+            amplitude *= -1;
+        }
+
+        int t_peak;
+        if (generator.uniform(0,1) < FRAC_EDGE){
+            t_peak = generator.uniform_int(0,SIZE_EDGE-1);
+            if (generator.uniform(0,1) < 0.5){
+                t_peak = SIZE_TRACE - 1 - t_peak;
+            }
+        }
+        else{
+            t_peak = generator.uniform_int(SIZE_EDGE,SIZE_TRACE-1-SIZE_EDGE);
+        }
+
+        generator.inject_template(trace,
+                                  flt.templates[template_id],
+                                  desampling_factor,
+                                  idx_desampled,
+                                  sample_peak_template,
+                                  t_peak,
+                                  amplitude);
+
+        // Same FLT-0 maximum search as in `main.cpp`
+        Eigen::ArrayXi trace_adc = generator.digitize(trace);
+        int t_max;
+        trace_adc.maxCoeff(&t_max);
+
+        traces.push_back(trace_adc);
+        t_maxs.push_back(t_max);
+    }
+
+    // Default FLT-0 window for all traces
+    vector<Eigen::Array2i> windows_default(n_traces,WINDOW_FLT0_DEFAULT);
+
+    // All engines, and the packed engine with smaller blocks
+    vector<EngineVariant> variants;
+    for (const FitEngine& fit_engine : get_fit_engines()){
+        variants.push_back({fit_engine_name(fit_engine),fit_engine,0});
+    }
+    for (const int& size_block : SIZE_BLOCKS){
+        if (size_block < (int)flt.templates.size()){
+            variants.push_back({"packed/" + to_string(size_block),FitEngine::PACKED,size_block});
+        }
+    }
+
+    // Run all engines on the same traces
+    vector< vector<FitOutcome> > outcomes(variants.size());
+    vector<double> times(variants.size());
+    for (size_t e=0; e<variants.size(); e++){
+        flt.set_fit_engine(variants[e].fit_engine);
+        flt.set_size_block(variants[e].size_block);
+        times[e] = run_engine(flt,traces,t_maxs,windows_default,outcomes[e]);
+    }
+    flt.set_size_block(0);
+
+    // Compare all engines to the reference
+    cout << endl << "*** " << template_file << ": " << n_traces << " traces ***" << endl;
+    int n_failed = compare_engines(flt,traces,t_maxs,windows_default,variants,outcomes,times);
+
+    // Polyphase engine with finer phase resolutions
+    flt.set_fit_engine(FitEngine::POLYPHASE);
+    for (const int& n_phases_factor : N_PHASES_FACTORS){
+        int n_phases = n_phases_factor*desampling_factor;
+        flt.set_n_phases(n_phases);
+
+        vector<FitOutcome> outcomes_polyphase;
+        double time = run_engine(flt,traces,t_maxs,windows_default,outcomes_polyphase);
+
+        int n_not_fitted = 0, n_mismatches = 0;
+        float dcorr_max = 0;
+        for (int n=0; n<n_traces; n++){
+            const FitOutcome& ref = outcomes[0][n];
+            const FitOutcome& out = outcomes_polyphase[n];
+
+            if (out.error || out.fitted != ref.fitted){
+                n_mismatches++;
+                continue;
+            }
+            if (!out.fitted){
+                n_not_fitted++;
+                continue;
+            }
+
+            float dcorr = out.corr_max_best - ref.corr_max_best;
+            dcorr_max = max(dcorr,dcorr_max);
+            n_mismatches += dcorr < -CORR_TOL;
+        }
+
+        if (n_mismatches > 0){
+            n_failed++;
+        }
+
+        cout << setw(12) << "polyphase/" + to_string(n_phases)
+             << setw(12) << fixed << setprecision(2) << 1e6*time/n_traces
+             << setw(10) << setprecision(2) << times[0]/time
+             << setw(12) << n_not_fitted
+             << setw(12) << "-"
+             << setw(12) << n_mismatches
+             << setw(14) << scientific << setprecision(2) << dcorr_max << endl;
+        cout.unsetf(ios::floatfield);
+    }
+    flt.set_n_phases(0);
+
+    // Const template fit with one TemplateFLT shared by several threads
+    int n_mismatches_shared = 0;
+    for (size_t e=0; e<variants.size(); e++){
+        flt.set_fit_engine(variants[e].fit_engine);
+        flt.set_size_block(variants[e].size_block);
+
+        vector<FitOutcome> outcomes_shared;
+        run_engine_shared(flt,traces,t_maxs,N_THREADS_SHARED,outcomes_shared);
+
+        for (int n=0; n<n_traces; n++){
+            const FitOutcome& ref = outcomes[e][n];
+            const FitOutcome& out = outcomes_shared[n];
+            n_mismatches_shared += out.error != ref.error
+                                   || out.fitted != ref.fitted
+                                   || out.template_id_best != ref.template_id_best
+                                   || out.idx_template_desampled_best != ref.idx_template_desampled_best
+                                   || out.t_peak_best != ref.t_peak_best
+                                   || out.corr_max_best != ref.corr_max_best;
+        }
+    }
+    flt.set_size_block(0);
+    if (n_mismatches_shared > 0){
+        n_failed++;
+    }
+
+    cout << "Const fit, one TemplateFLT shared by " << N_THREADS_SHARED << " threads: "
+         << n_mismatches_shared << " mismatches over all engines" << endl;
+
+    // All engines with the preprocessing enabled: pedestal subtraction, absolute peak search and saturation count
+    PreprocessConfig preprocess_config;
+    preprocess_config.size_baseline = SIZE_BASELINE_PREPROCESS;
+    preprocess_config.peak_abs = true;
+    preprocess_config.saturation_level = SATURATION_LEVEL_PREPROCESS;
+    flt.set_preprocess_config(preprocess_config);
+
+    // The trace maximum is searched in the fused preprocessing pass
+    // Every other trace in its own FLT-0 window around its maximum, the others in the default window
+    vector<int> t_maxs_search(n_traces,-1);
+    vector<Eigen::Array2i> windows_flt0 = windows_default;
+    for (int n=1; n<n_traces; n+=2){
+        int window_start = max(t_maxs[n]-SIZE_WINDOW_FLT0/2,0);
+        windows_flt0[n] = Eigen::Array2i(window_start,min(window_start+SIZE_WINDOW_FLT0,SIZE_TRACE));
+    }
+
+    vector< vector<FitOutcome> > outcomes_preprocess(variants.size());
+    vector<double> times_preprocess(variants.size());
+    for (size_t e=0; e<variants.size(); e++){
+        flt.set_fit_engine(variants[e].fit_engine);
+        flt.set_size_block(variants[e].size_block);
+        times_preprocess[e] = run_engine(flt,traces,t_maxs_search,windows_flt0,outcomes_preprocess[e]);
+    }
+    flt.set_size_block(0);
+
+    cout << endl << "With preprocessing: pedestal of " << SIZE_BASELINE_PREPROCESS << " samples, absolute peak search, "
+         << "saturation level " << SATURATION_LEVEL_PREPROCESS << endl;
+    n_failed += compare_engines(flt,traces,t_maxs_search,windows_flt0,variants,outcomes_preprocess,times_preprocess);
+
+    // The trace maximum must be found within the FLT-0 window of each trace
+    int n_outside_window = 0;
+    PreprocessedTrace preprocessed;
+    for (int n=1; n<n_traces; n+=2){
+        flt.preprocess(traces[n],-1,preprocessed,windows_flt0[n]);
+        n_outside_window += preprocessed.t_max < windows_flt0[n](0) || preprocessed.t_max >= windows_flt0[n](1);
+    }
+    if (n_outside_window > 0){
+        n_failed++;
+    }
+
+    cout << "FLT-0 windows of " << SIZE_WINDOW_FLT0 << " samples: " << n_outside_window << " trace maxima outside the window" << endl;
+
+    // Every engine must flag the saturated samples of the trace
+    int n_saturated = 0, n_mismatches_saturated = 0;
+    for (int n=0; n<n_traces; n++){
+        int n_saturated_n = ( traces[n].abs() >= SATURATION_LEVEL_PREPROCESS ).count();
+        n_saturated += n_saturated_n > 0;
+        for (size_t e=0; e<variants.size(); e++){
+            const FitOutcome& out = outcomes_preprocess[e][n];
+            n_mismatches_saturated += out.error || out.n_saturated != n_saturated_n;
+        }
+    }
+    if (n_mismatches_saturated > 0){
+        n_failed++;
+    }
+
+    cout << "Saturation: " << n_saturated << " saturated traces, "
+         << n_mismatches_saturated << " mismatches of the number of saturated samples over all engines" << endl;
+    flt.set_preprocess_config( PreprocessConfig() );
+
+    // Pre-filter in verification mode, with the subspace cut derived from the correlation threshold
+    flt.set_fit_engine(FitEngine::PACKED);
+    for (const float& corr_thresh : CORR_THRESHS_PREFILTER){
+        flt.set_corr_thresh(corr_thresh);
+
+        PreFilterConfig prefilter_config;
+        prefilter_config.enabled = true;
+        prefilter_config.verify = true;
+        prefilter_config.n_components = N_COMPONENTS_PREFILTER;
+        flt.set_prefilter_config(prefilter_config);
+
+        for (int n=0; n<n_traces; n++){
+            flt.trigger(traces[n],t_maxs[n]);
+        }
+
+        PreFilterStats stats = flt.get_prefilter_stats();
+        if (stats.n_false_vetoes > 0 || stats.n_verified != stats.n_rejected){
+            n_failed++;
+        }
+
+        cout << "Pre-filter verification, corr_thresh = " << corr_thresh
+             << ": min_corr_subspace = " << PreFilter(flt.templates_desampled,prefilter_config,corr_thresh).get_min_corr_subspace() << ", "
+             << stats.n_rejected << " rejected, " << stats.n_false_vetoes << " false vetoes" << endl;
+    }
+    flt.set_prefilter_config( PreFilterConfig() );
+    flt.set_corr_thresh(0);
+
+    return n_failed;
+}
+
+
+int main(int argc, char* argv[]){
+    int n_traces = 2000;
+    unsigned int seed = 1;
+    vector<string> template_files = TEMPLATE_FILES;
+
+    if (argc > 1){
+        n_traces = stoi(argv[1]);
+    }
+    if (argc > 2){
+        seed = stoul(argv[2]);
+    }
+    if (argc > 3){
+        template_files = vector<string>(argv+3,argv+argc);
+    }
+
+    int n_failed = 0;
+    for (const string& template_file : template_files){
+        n_failed += test_template_file(template_file,n_traces,seed);
+    }
+
+    cout << endl << (n_failed == 0 ? "PASSED" : "FAILED") << ": all engines vs. reference, CORR_TOL = " << CORR_TOL << endl;
+
+    return n_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+/*
+/////////////////////////////////////
+//** JOURNAL READER SOURCE FILE ** //
+/////////////////////////////////////
+
+Dumps or summarizes journal files written by the result journal (see `journal.h`).
+
+Build from the repository root:
+    g++ -O3 -pthread tools/journal_reader.cpp journal.cpp error_handling.cpp -o journal_reader
+
+Usage:
+    ./journal_reader dump journal_file [journal_file ...]
+    ./journal_reader summary journal_file [journal_file ...]
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+#include "../journal.h"
+
+using namespace std;
+
+// Number of most frequent best-fit templates listed in the summary
+int N_TOP_TEMPLATES = 10;
+
+
+void dump(const vector<JournalRecord>& records){
+    for (const JournalRecord& record : records){
+        cout << record.event_id << " "
+             << record.unit << " "
+             << record.channel << " "
+             << record.template_id_best << " "
+             << (int)record.idx_template_desampled_best << " "
+             << record.t_peak_best << " "
+             << record.corr_max_best << " "
+             << (int)record.decision << " "
+             << record.latency_ns << "\n";
+    }
+}
+
+
+void summary(const vector<JournalRecord>& records){
+    if (records.empty()){
+        cout << "No records" << endl;
+        return;
+    }
+
+    map<int,long> n_records_channel, n_triggered_channel;
+    map<int,long> n_best_template;
+    vector<uint32_t> latencies;
+    double corr_sum = 0;
+    uint64_t event_id_min = records[0].event_id, event_id_max = records[0].event_id;
+
+    for (const JournalRecord& record : records){
+        n_records_channel[record.channel]++;
+        n_triggered_channel[record.channel] += record.decision;
+        n_best_template[record.template_id_best]++;
+        latencies.push_back(record.latency_ns);
+        corr_sum += record.corr_max_best;
+        event_id_min = min(event_id_min,record.event_id);
+        event_id_max = max(event_id_max,record.event_id);
+    }
+    sort(latencies.begin(),latencies.end());
+
+    cout << "Records: " << records.size() << ", event IDs [" << event_id_min << "," << event_id_max << "]" << endl;
+    cout << "Mean corr_max_best: " << corr_sum/records.size() << endl;
+    for (const auto& [channel,n_records] : n_records_channel){
+        cout << "Channel " << channel << ": " << n_records << " records, " << n_triggered_channel[channel] << " triggered ("
+             << fixed << setprecision(2) << 100.*n_triggered_channel[channel]/n_records << "%)" << endl;
+        cout.unsetf(ios::floatfield);
+    }
+
+    cout << "Latency [us]:" << fixed << setprecision(1);
+    vector< pair<string,double> > quantiles = {{"p50",0.5},{"p90",0.9},{"p99",0.99},{"p99.9",0.999}};
+    for (const auto& [label,q] : quantiles){
+        cout << " " << label << "=" << latencies[ min(latencies.size()-1,(size_t)(q*latencies.size())) ]/1e3;
+    }
+    cout << endl;
+    cout.unsetf(ios::floatfield);
+
+    vector< pair<long,int> > top_templates;
+    for (const auto& [template_id,n] : n_best_template){
+        top_templates.push_back({n,template_id});
+    }
+    sort(top_templates.rbegin(),top_templates.rend());
+    cout << "Most frequent best-fit templates (ID:count):";
+    for (int i=0; i<min(N_TOP_TEMPLATES,(int)top_templates.size()); i++){
+        cout << " " << top_templates[i].second << ":" << top_templates[i].first;
+    }
+    cout << endl;
+}
+
+
+int main(int argc, char* argv[]){
+    if (argc < 3){
+        cerr << "Usage: " << argv[0] << " dump|summary journal_file [journal_file ...]" << endl;
+        return 1;
+    }
+
+    string command = argv[1];
+
+    vector<JournalRecord> records;
+    for (int i=2; i<argc; i++){
+        JournalFileHeader header;
+        vector<JournalRecord> records_file = read_journal_file(argv[i],header);
+        records.insert(records.end(),records_file.begin(),records_file.end());
+    }
+
+    if (command == "dump"){
+        cout << "# event_id unit channel template_id_best idx_template_desampled_best t_peak_best corr_max_best decision latency_ns" << endl;
+        dump(records);
+    }
+    else if (command == "summary"){
+        summary(records);
+    }
+    else{
+        cerr << "Unknown command: " << command << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,300 @@
+/*
+///////////////////////////////////
+//** JOURNAL TEST SOURCE FILE ** //
+///////////////////////////////////
+
+Test of the result journal (see `journal.h`):
+- ring wraparound: records are appended and popped in chunks over many turns of a small ring,
+  and must come out in order; appending to a full ring drops and counts the record,
+- rotation: more records than fit in `max_files` files are written, only the last `max_files` files
+  must be kept, with the last records in order,
+- dropped records: with a small ring and a slow flush thread, every record must be either written or
+  counted as dropped,
+- invalid configurations are rejected by the constructor,
+- an I/O error of the flush thread (the directory of the journal is removed) must not terminate the program,
+  but be reported by `close` and `get_error`, with the unwritten records counted as dropped,
+- no space for a journal file (the file size limit of the process is set below the size of a file):
+  the constructor must fail to reserve the first file, and the flush thread must report the failure
+  to reserve the next file like any other I/O error.
+
+The journal files are written to a temporary directory, which is removed at the end.
+
+Build from the repository root:
+    g++ -O3 -pthread tools/journal_test.cpp journal.cpp error_handling.cpp -o journal_test
+
+Usage:
+    ./journal_test
+
+Returns 0 if all checks pass, 1 otherwise.
+*/
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "../journal.h"
+
+using namespace std;
+
+// Number of failed checks
+int N_FAILED = 0;
+
+/*
+Prints the outcome of a check and counts it if it failed.
+*/
+void check(const bool& passed,
+           const string& description){
+    cout << (passed ? "    ok: " : "FAILED: ") << description << endl;
+    N_FAILED += !passed;
+}
+
+
+/*
+Returns a record with an event ID.
+*/
+JournalRecord make_record(const uint64_t& event_id){
+    JournalRecord record = {};
+    record.event_id = event_id;
+    record.unit = event_id % 100;
+
+    return record;
+}
+
+
+/*
+Appends and pops records in chunks over many turns of a ring of capacity 4.
+*/
+void test_ring_wraparound(){
+    cout << "*** Ring wraparound ***" << endl;
+
+    JournalRing ring(3);
+
+    uint64_t n_appended = 0, n_popped = 0;
+    bool in_order = true;
+    JournalRecord records_out[4];
+    for (int turn=0; turn<1000; turn++){
+        // Chunks of 1 to 4 records, such that the positions wrap around at every turn
+        int size_chunk = 1 + turn % 4;
+        for (int i=0; i<size_chunk; i++){
+            ring.append( make_record(n_appended++) );
+        }
+
+        size_t n_out = ring.pop(records_out,4);
+        for (size_t i=0; i<n_out; i++){
+            in_order = in_order && records_out[i].event_id == n_popped++;
+        }
+    }
+    check(n_popped == n_appended && in_order,"records come out in order over " + to_string(n_appended) + " appends");
+    check(ring.get_n_dropped() == 0,"no record dropped while the ring is drained");
+
+    // Fill the ring and append 3 more records
+    for (int i=0; i<7; i++){
+        ring.append( make_record(n_appended++) );
+    }
+    check(ring.get_n_dropped() == 3,"3 records dropped when appending 7 records to a ring of capacity 4");
+
+    size_t n_out = ring.pop(records_out,4);
+    check(n_out == 4 && records_out[0].event_id == n_popped && records_out[3].event_id == n_popped+3,
+          "the 4 records appended before the ring was full are kept");
+}
+
+
+/*
+Writes 95 records to files of 10 records, and keeps the last 3 files.
+*/
+void test_rotation(const string& dir){
+    cout << "*** Rotation ***" << endl;
+
+    string path_prefix = dir + "/rotation";
+    int n_records = 95, n_records_per_file = 10, max_files = 3;
+
+    Journal journal(path_prefix,n_records_per_file,max_files,1024,1);
+    JournalRing* ring = journal.register_writer();
+    for (int i=0; i<n_records; i++){
+        ring->append( make_record(i) );
+    }
+    bool ok = journal.close();
+
+    check(ok && journal.get_error().empty(),"journal closed without error");
+    check(journal.get_n_written() == (uint64_t)n_records && journal.get_n_dropped() == 0,"all records written");
+
+    // Files 0 to 9 were written, only files 7 to 9 are kept
+    int idx_file_last = (n_records-1) / n_records_per_file;
+    bool removed = true;
+    for (int idx_file=0; idx_file<=idx_file_last-max_files; idx_file++){
+        removed = removed && access(journal_file_name(path_prefix,idx_file).c_str(),F_OK) != 0;
+    }
+    check(removed,"files older than the last " + to_string(max_files) + " files removed");
+
+    uint64_t event_id = (idx_file_last-max_files+1)*n_records_per_file;
+    bool in_order = true;
+    for (int idx_file=idx_file_last-max_files+1; idx_file<=idx_file_last; idx_file++){
+        JournalFileHeader header;
+        vector<JournalRecord> records = read_journal_file(journal_file_name(path_prefix,idx_file),header);
+        in_order = in_order && header.idx_file == (uint32_t)idx_file && header.n_records == records.size();
+        for (const JournalRecord& record : records){
+            in_order = in_order && record.event_id == event_id++;
+        }
+    }
+    check(in_order && event_id == (uint64_t)n_records,"last files hold the last records in order");
+}
+
+
+/*
+Appends records faster than a slow flush thread drains a small ring.
+*/
+void test_dropped(const string& dir){
+    cout << "*** Dropped records ***" << endl;
+
+    int n_records = 1000;
+
+    Journal journal(dir + "/dropped",1<<10,2,16,100);
+    JournalRing* ring = journal.register_writer();
+    for (int i=0; i<n_records; i++){
+        ring->append( make_record(i) );
+    }
+    journal.close();
+
+    check(journal.get_n_dropped() > 0,to_string(journal.get_n_dropped()) + " records dropped by a ring of capacity 16");
+    check(journal.get_n_written() + journal.get_n_dropped() == (uint64_t)n_records,"every record is written or counted as dropped");
+}
+
+
+/*
+Checks that invalid configurations are rejected.
+*/
+void test_invalid(const string& dir){
+    cout << "*** Invalid configurations ***" << endl;
+
+    bool thrown = false;
+    try{
+        Journal journal(dir + "/invalid",0);
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown,"0 records per file rejected");
+
+    thrown = false;
+    try{
+        Journal journal(dir + "/invalid",10,0);
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    check(thrown,"0 files kept rejected");
+}
+
+
+/*
+Removes the directory of a journal, such that the flush thread fails to open the next file.
+*/
+void test_io_error(const string& dir){
+    cout << "*** I/O error ***" << endl;
+
+    string dir_error = dir + "/error";
+    string path_prefix = dir_error + "/error";
+    int n_records = 25, n_records_per_file = 10;
+
+    if (mkdir(dir_error.c_str(),0755) != 0){
+        check(false,"create directory " + dir_error);
+        return;
+    }
+
+    Journal journal(path_prefix,n_records_per_file,2,1024,1);
+    unlink( journal_file_name(path_prefix,0).c_str() );
+    rmdir( dir_error.c_str() );
+
+    JournalRing* ring = journal.register_writer();
+    for (int i=0; i<n_records; i++){
+        ring->append( make_record(i) );
+    }
+
+    // Give the flush thread time to fill the first file and fail to open the next one
+    this_thread::sleep_for( chrono::milliseconds(200) );
+    check(!journal.get_error().empty(),"error recorded by the flush thread: " + journal.get_error());
+
+    bool ok = journal.close();
+    check(!ok,"close reports the error");
+    check(journal.get_n_written() == (uint64_t)n_records_per_file,"first file written before the error");
+    check(journal.get_n_written() + journal.get_n_dropped() == (uint64_t)n_records,"unwritten records counted as dropped");
+}
+
+
+/*
+Sets the file size limit of the process below the size of a journal file, like a disk that is too small,
+such that the blocks of a journal file cannot be reserved.
+*/
+void test_no_space(const string& dir){
+    cout << "*** No space for a journal file ***" << endl;
+
+    int n_records = 25, n_records_per_file = 10;
+    size_t size_file = sizeof(JournalFileHeader) + n_records_per_file*sizeof(JournalRecord);
+
+    // Exceeding the file size limit fails the call instead of raising SIGXFSZ
+    signal(SIGXFSZ,SIG_IGN);
+    struct rlimit limit_default, limit_small;
+    getrlimit(RLIMIT_FSIZE,&limit_default);
+    limit_small = limit_default;
+    limit_small.rlim_cur = size_file / 2;
+
+    setrlimit(RLIMIT_FSIZE,&limit_small);
+    bool thrown = false;
+    try{
+        Journal journal(dir + "/no_space_open",n_records_per_file);
+    }
+    catch (const runtime_error& err){
+        thrown = true;
+    }
+    setrlimit(RLIMIT_FSIZE,&limit_default);
+    check(thrown,"constructor fails if the first file cannot be reserved");
+
+    // The first file is reserved, the next one is not
+    Journal journal(dir + "/no_space_rotate",n_records_per_file,2,1024,1);
+    setrlimit(RLIMIT_FSIZE,&limit_small);
+
+    JournalRing* ring = journal.register_writer();
+    for (int i=0; i<n_records; i++){
+        ring->append( make_record(i) );
+    }
+
+    // Give the flush thread time to fill the first file and fail to reserve the next one
+    this_thread::sleep_for( chrono::milliseconds(200) );
+    bool ok = journal.close();
+    setrlimit(RLIMIT_FSIZE,&limit_default);
+
+    check(!ok && !journal.get_error().empty(),"close reports the error of the flush thread: " + journal.get_error());
+    check(journal.get_n_written() == (uint64_t)n_records_per_file,"first file written before the error");
+    check(journal.get_n_written() + journal.get_n_dropped() == (uint64_t)n_records,"unwritten records counted as dropped");
+}
+
+
+int main(){
+    char dir_template[] = "/tmp/journal_test.XXXXXX";
+    char* dir = mkdtemp(dir_template);
+    if (!dir){
+        cerr << "Error creating temporary directory" << endl;
+        return 1;
+    }
+
+    test_ring_wraparound();
+    test_rotation(dir);
+    test_dropped(dir);
+    test_invalid(dir);
+    test_io_error(dir);
+    test_no_space(dir);
+
+    // Remove the temporary directory
+    string command = "rm -rf " + string(dir);
+    if (system( command.c_str() ) != 0){
+        cerr << "Error removing " << dir << endl;
+    }
+
+    cout << endl << (N_FAILED == 0 ? "PASSED" : "FAILED") << ": journal test" << endl;
+
+    return N_FAILED == 0 ? 0 : 1;
+}
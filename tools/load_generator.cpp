@@ -0,0 +1,664 @@
+/*
+/////////////////////////////////////
+//** LOAD GENERATOR SOURCE FILE ** //
+/////////////////////////////////////
+
+Synthetic load generator for end-to-end throughput testing of the Template FLT-1.
+
+A pool of detector-unit events is synthesized before the run. Each event contains an X and Y trace
+with Gaussian noise and one narrow-band RFI line per detector unit. A fraction of the events contains
+an air-shower pulse: a random template of the library with a random phase, amplitude and polarization angle,
+injected with amplitude*cos(angle) in X and amplitude*sin(angle) in Y.
+Each detector unit has its own FLT-0 rate, and contributes to the pool proportionally to this rate.
+
+Events are dispatched to a FLT-0 buffer with Poisson arrival times at a fixed or ramping total event rate.
+Worker threads (one per core) decide the events with the const `TemplateFLT::trigger`, the same API as production.
+All workers share one TemplateFLT, each with its own scratch per polarization.
+A worker takes up to `--batch` events from the buffer at once, fits all their traces, and decides them in one pass
+with one snapshot of the threshold table of the decision stage (see `decision.h`), with per-unit and per-channel thresholds around
+`--corr-thresh` (uniformly spread by `--thresh-spread`, or read from `--thresholds`). With `--thresh-update-ms`,
+a monitoring thread publishes a new threshold table at this period during the run, without pausing the workers.
+With `--prefilter on`, the pre-filter (see `prefilter.h`) rejects traces before the template fit, with the subspace cut
+of `--prefilter-components` principal components derived from the lowest threshold. With `--prefilter verify`,
+rejected traces are fitted too, and the false vetoes with respect to the threshold of their unit are counted.
+If the buffer is full when an event arrives, the event is dropped (the FLT-0 buffer is overwritten).
+With `--engine auto`, the fastest engine for the configuration and CPU is selected by the autotuner
+(see `autotune.h`), with its decision cached in `--autotune-cache`.
+With `--engine anytime`, each fit is limited to a time budget of `--budget-us` (0 = unlimited),
+counted from the arrival of the event, such that the time spent in the FLT-0 buffer is charged to the budget,
+and the budget overruns and completion fraction are reported per detector unit.
+If `--journal` is given, every decision is recorded in the result journal (see `journal.h`).
+For each rate step, the sustained throughput and the latency percentiles (arrival to decision) are reported.
+In ramp mode, the rate is increased until the trigger saturates, i.e. until the throughput falls below 95% of
+the offered rate, more than 1% of the events are dropped, or the 99th latency percentile exceeds `--max-latency`.
+
+Build from the repository root:
+    g++ -O3 -pthread tools/load_generator.cpp template_FLT.cpp prefilter.cpp polyphase.cpp preprocessing.cpp autotune.cpp trace_generator.cpp journal.cpp decision.cpp utils.cpp error_handling.cpp -o load_generator
+
+Usage (all options are optional, defaults in brackets):
+    ./load_generator --templates [templates_96_XY_rfv2.txt] --engine [reference|packed|anytime|polyphase|auto] --size-block [0] --budget-us [0] --n-phases [0] --threads [1] --mode [fixed|ramp]
+                     --units [100] --flt0-rate [100] --flt0-rate-spread [0.5]
+                     --signal-frac [0.1] --amp-min [20] --amp-max [200] --pol-angle-max [90]
+                     --noise-sigma [5] --rfi-amp [5] --rfi-freq-min [50] --rfi-freq-max [200]
+                     --corr-thresh [0.7] --thresh-spread [0] --thresholds [file, off] --thresh-update-ms [0] --batch [1] --rate [total FLT-0 rate] --rate-start [1000] --rate-step [1000] --rate-max [1e6]
+                     --duration [2] --buffer [1024] --pool [4096] --max-latency [10] --seed [1] --journal [path prefix, off]
+                     --autotune-cache [template_flt_autotune.txt] --prefilter [off|on|verify] --prefilter-components [16]
+Rates are in Hz, frequencies in MHz, amplitudes in ADC counts, angles in degrees, durations in s and latencies in ms.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include "../template_FLT.h"
+#include "../trace_generator.h"
+#include "../journal.h"
+#include "../decision.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Number of samples of a trace
+int SIZE_TRACE = 1024;
+
+/*
+Detector-unit event as read out after a FLT-0 trigger.
+*/
+struct Event{
+    int unit;
+    Eigen::ArrayXi trace_x;
+    Eigen::ArrayXi trace_y;
+    int t_max_x;
+    int t_max_y;
+};
+
+/*
+Event in the FLT-0 buffer, with its arrival time.
+*/
+struct BufferEntry{
+    uint64_t event_id;
+    const Event* event;
+    Clock::time_point arrival;
+};
+
+/*
+Result of one rate step.
+*/
+struct StepResult{
+    double rate_offered;
+    double throughput;
+    long n_dispatched;
+    long n_dropped;
+    long n_triggered;
+    double latency_p50;
+    double latency_p90;
+    double latency_p99;
+    double latency_p999;
+    bool saturated;
+};
+
+
+/*
+Command-line options of the form `--key value`.
+*/
+class Options{
+    private:
+        map<string,string> values;
+
+    public:
+        Options(int argc, char* argv[]){
+            for (int i=1; i+1<argc; i+=2){
+                string key = argv[i];
+                if (key.rfind("--",0) != 0){
+                    throw runtime_error("Invalid option: " + key);
+                }
+                values[key.substr(2)] = argv[i+1];
+            }
+        }
+
+        bool has(const string& key){
+            return values.count(key) > 0;
+        }
+
+        string get(const string& key, const string& value_default){
+            return has(key) ? values[key] : value_default;
+        }
+
+        double get(const string& key, const double& value_default){
+            return has(key) ? stod(values[key]) : value_default;
+        }
+};
+
+
+/*
+Synthesizes the pool of detector-unit events.
+*/
+vector<Event> generate_pool(TemplateFLT& flt,
+                            Options& options){
+    TraceGenerator generator( (unsigned int)options.get("seed",1.) );
+
+    int n_pool = options.get("pool",4096.);
+    int n_units = options.get("units",100.);
+    double flt0_rate = options.get("flt0-rate",100.);
+    double flt0_rate_spread = options.get("flt0-rate-spread",0.5);
+    double signal_frac = options.get("signal-frac",0.1);
+    double amp_min = options.get("amp-min",20.);
+    double amp_max = options.get("amp-max",200.);
+    double pol_angle_max = options.get("pol-angle-max",90.)*M_PI/180;
+    double noise_sigma = options.get("noise-sigma",5.);
+    double rfi_amp = options.get("rfi-amp",5.);
+    double rfi_freq_min = options.get("rfi-freq-min",50.);
+    double rfi_freq_max = options.get("rfi-freq-max",200.);
+
+    // FLT-0 rate and RFI line of each detector unit
+    vector<double> unit_rates(n_units);
+    vector<float> unit_rfi_freqs(n_units);
+    for (int u=0; u<n_units; u++){
+        unit_rates[u] = flt0_rate*generator.uniform(1-flt0_rate_spread,1+flt0_rate_spread);
+        unit_rfi_freqs[u] = generator.uniform(rfi_freq_min,rfi_freq_max);
+    }
+    discrete_distribution<int> unit_dist(unit_rates.begin(),unit_rates.end());
+    mt19937 rng(generator.uniform_int(0,1<<30));
+
+    vector<Event> pool;
+    for (int n=0; n<n_pool; n++){
+        Event event;
+        event.unit = unit_dist(rng);
+
+        Eigen::ArrayXf trace_x = generator.noise(SIZE_TRACE,noise_sigma);
+        Eigen::ArrayXf trace_y = generator.noise(SIZE_TRACE,noise_sigma);
+        generator.add_rfi(trace_x,unit_rfi_freqs[event.unit],rfi_amp,generator.uniform(0,2*M_PI),flt.get_adc_sampling_rate());
+        generator.add_rfi(trace_y,unit_rfi_freqs[event.unit],rfi_amp,generator.uniform(0,2*M_PI),flt.get_adc_sampling_rate());
+
+        if (generator.uniform(0,1) < signal_frac){
+            int template_id = generator.uniform_int(0,flt.templates.size()-1);
+            int idx_desampled = generator.uniform_int(0,flt.get_desampling_factor()-1);
+            int t_peak = generator.uniform_int(SIZE_TRACE/4,3*SIZE_TRACE/4);
+            float amplitude = generator.uniform(amp_min,amp_max);
+            float pol_angle = generator.uniform(0,pol_angle_max);
+
+            generator.inject_template(trace_x,flt.templates[template_id],flt.get_desampling_factor(),idx_desampled,
+                                      flt.get_sample_peak_template(),t_peak,amplitude*cos(pol_angle));
+            generator.inject_template(trace_y,flt.templates[template_id],flt.get_desampling_factor(),idx_desampled,
+                                      flt.get_sample_peak_template(),t_peak,amplitude*sin(pol_angle));
+        }
+
+        event.trace_x = generator.digitize(trace_x);
+        event.trace_y = generator.digitize(trace_y);
+
+        // FLT-0 maximum, kept away from the trace edges where the trace segment is too short
+        int margin = 2*flt.get_size_template_desampled();
+        event.trace_x.segment(margin,SIZE_TRACE-2*margin).maxCoeff(&event.t_max_x);
+        event.trace_y.segment(margin,SIZE_TRACE-2*margin).maxCoeff(&event.t_max_y);
+        event.t_max_x += margin;
+        event.t_max_y += margin;
+
+        pool.push_back(event);
+    }
+
+    return pool;
+}
+
+
+/*
+Returns the percentile `q` between [0,1] of sorted values.
+*/
+double percentile(const vector<double>& values_sorted,
+                  const double& q){
+    if (values_sorted.empty()){
+        return 0;
+    }
+
+    return values_sorted[ min(values_sorted.size()-1,(size_t)(q*values_sorted.size())) ];
+}
+
+
+/*
+Runs one rate step: dispatches events at `rate` for `duration` and processes them with `flt`,
+one worker thread per entry of `scratches`.
+*/
+StepResult run_step(const TemplateFLT& flt,
+                    vector< pair<FitScratch,FitScratch> >& scratches,
+                    const DecisionStage& decision_stage,
+                    const size_t& size_batch,
+                    const vector<Event>& pool,
+                    const double& rate,
+                    const double& duration,
+                    const size_t& size_buffer,
+                    const double& max_latency,
+                    mt19937& rng,
+                    uint64_t& event_id,
+                    const vector<JournalRing*>& journal_rings,
+                    map<int,BudgetStats>& unit_budget_stats){
+    deque<BufferEntry> buffer;
+    mutex buffer_mutex;
+    condition_variable buffer_cv;
+    bool done = false;
+
+    // Latencies [ms] and number of triggers per worker
+    vector< vector<double> > latencies(scratches.size());
+    vector<long> n_triggered(scratches.size(),0);
+    // Counters of the anytime fit per detector unit and per worker
+    vector< map<int,BudgetStats> > unit_budget_stats_workers(scratches.size());
+
+    // Engine of the shared TemplateFLT
+    FitEngine fit_engine = flt.get_fit_engine();
+
+    // Worker threads
+    vector<thread> threads;
+    for (size_t w=0; w<scratches.size(); w++){
+        threads.emplace_back([&,w](){
+            FitScratch& scratch_x = scratches[w].first;
+            FitScratch& scratch_y = scratches[w].second;
+            JournalRing* journal_ring = journal_rings[w];
+
+            // Events of the batch, and their fit results and decisions in the order X, Y of each event
+            vector<BufferEntry> entries;
+            vector<FitResult> results;
+            DecisionBatch batch;
+            ArrayXb decisions;
+
+            // Snapshot of the threshold table for the batch, and the unit and channel of the current trace
+            // for the false vetoes of the pre-filter verification
+            shared_ptr<const ThresholdTable> table;
+            int unit_trace = 0, channel_trace = 0;
+            ThresholdSource threshold_source = [&table,&unit_trace,&channel_trace](const FitResult& result){
+                return get_threshold(*table,unit_trace,channel_trace,result.template_id_best);
+            };
+            while (true){
+                entries.clear();
+                {
+                    unique_lock<mutex> lock(buffer_mutex);
+                    buffer_cv.wait(lock,[&](){ return done || !buffer.empty(); });
+                    if (buffer.empty()){
+                        return;
+                    }
+                    while (!buffer.empty() && entries.size() < size_batch){
+                        entries.push_back( buffer.front() );
+                        buffer.pop_front();
+                    }
+                }
+
+                // Fit all traces of the batch, then decide them at once with one snapshot of the threshold table
+                table = decision_stage.get_table();
+                results.resize(2*entries.size());
+                clear_batch(batch);
+                for (size_t b=0; b<entries.size(); b++){
+                    const BufferEntry& entry = entries[b];
+                    unit_trace = entry.event->unit;
+                    channel_trace = 0;
+                    flt.trigger(entry.event->trace_x,entry.event->t_max_x,scratch_x,results[2*b],WINDOW_FLT0_DEFAULT,entry.arrival,threshold_source);
+                    add_to_batch(batch,unit_trace,channel_trace,results[2*b]);
+                    channel_trace = 1;
+                    flt.trigger(entry.event->trace_y,entry.event->t_max_y,scratch_y,results[2*b+1],WINDOW_FLT0_DEFAULT,entry.arrival,threshold_source);
+                    add_to_batch(batch,unit_trace,channel_trace,results[2*b+1]);
+                }
+                decide_batch(*table,batch,decisions);
+
+                Clock::time_point decided = Clock::now();
+                for (size_t b=0; b<entries.size(); b++){
+                    const BufferEntry& entry = entries[b];
+
+                    n_triggered[w] += decisions(2*b) || decisions(2*b+1);
+                    if (fit_engine == FitEngine::ANYTIME){
+                        BudgetStats& stats = unit_budget_stats_workers[w][entry.event->unit];
+                        for (int channel=0; channel<2; channel++){
+                            const FitResult& result = results[2*b+channel];
+                            // Traces rejected by the pre-filter are not fitted
+                            if (result.n_templates_evaluated == 0){
+                                continue;
+                            }
+                            stats.n_fits++;
+                            stats.n_overruns += !result.fit_complete;
+                            stats.sum_completion_fraction += (double)result.n_templates_evaluated / flt.templates.size();
+                        }
+                    }
+
+                    Clock::duration latency = decided-entry.arrival;
+                    latencies[w].push_back( chrono::duration<double,milli>(latency).count() );
+
+                    if (journal_ring){
+                        uint32_t latency_ns = min( chrono::duration_cast<chrono::nanoseconds>(latency).count(),(long)UINT32_MAX );
+                        for (int channel=0; channel<2; channel++){
+                            const FitResult& result = results[2*b+channel];
+                            JournalRecord record;
+                            record.event_id = entry.event_id;
+                            record.unit = entry.event->unit;
+                            record.channel = channel;
+                            record.decision = decisions(2*b+channel);
+                            record.idx_template_desampled_best = result.idx_template_desampled_best;
+                            record.template_id_best = result.template_id_best;
+                            record.t_peak_best = result.t_peak_best;
+                            record.corr_max_best = result.corr_max_best;
+                            record.latency_ns = latency_ns;
+                            journal_ring->append(record);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    // Dispatch events with Poisson arrival times
+    exponential_distribution<double> interarrival(rate);
+    long n_dispatched = 0, n_dropped = 0;
+    Clock::time_point start = Clock::now();
+    Clock::time_point arrival = start;
+    Clock::time_point end = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(duration));
+    while (true){
+        arrival += chrono::duration_cast<Clock::duration>(chrono::duration<double>( interarrival(rng) ));
+        if (arrival >= end){
+            break;
+        }
+        // Only sleep if the dispatcher is ahead of schedule
+        if (arrival - Clock::now() > chrono::microseconds(50)){
+            this_thread::sleep_until(arrival);
+        }
+
+        const Event* event = &pool[event_id % pool.size()];
+        n_dispatched++;
+        {
+            lock_guard<mutex> lock(buffer_mutex);
+            if (buffer.size() >= size_buffer){
+                event_id++;
+                n_dropped++;
+                continue;
+            }
+            buffer.push_back({event_id++,event,arrival});
+        }
+        buffer_cv.notify_one();
+    }
+
+    // Process the remaining events in the buffer
+    {
+        lock_guard<mutex> lock(buffer_mutex);
+        done = true;
+    }
+    buffer_cv.notify_all();
+    for (thread& t : threads){
+        t.join();
+    }
+    double elapsed = chrono::duration<double>(Clock::now()-start).count();
+
+    // Merge the results of all workers
+    vector<double> latencies_all;
+    StepResult result;
+    result.n_triggered = 0;
+    for (size_t w=0; w<scratches.size(); w++){
+        latencies_all.insert(latencies_all.end(),latencies[w].begin(),latencies[w].end());
+        result.n_triggered += n_triggered[w];
+        for (const auto& [unit,stats] : unit_budget_stats_workers[w]){
+            unit_budget_stats[unit].n_fits += stats.n_fits;
+            unit_budget_stats[unit].n_overruns += stats.n_overruns;
+            unit_budget_stats[unit].sum_completion_fraction += stats.sum_completion_fraction;
+        }
+    }
+    sort(latencies_all.begin(),latencies_all.end());
+
+    result.rate_offered = rate;
+    result.throughput = latencies_all.size()/elapsed;
+    result.n_dispatched = n_dispatched;
+    result.n_dropped = n_dropped;
+    result.latency_p50 = percentile(latencies_all,0.5);
+    result.latency_p90 = percentile(latencies_all,0.9);
+    result.latency_p99 = percentile(latencies_all,0.99);
+    result.latency_p999 = percentile(latencies_all,0.999);
+    result.saturated = result.throughput < 0.95*n_dispatched/duration
+                       || n_dropped > 0.01*n_dispatched
+                       || result.latency_p99 > max_latency;
+
+    return result;
+}
+
+
+void print_step(const StepResult& result){
+    cout << setw(12) << fixed << setprecision(0) << result.rate_offered
+         << setw(12) << result.throughput
+         << setw(10) << result.n_dispatched
+         << setw(10) << result.n_dropped
+         << setw(10) << result.n_triggered
+         << setw(10) << setprecision(3) << result.latency_p50
+         << setw(10) << result.latency_p90
+         << setw(10) << result.latency_p99
+         << setw(10) << result.latency_p999
+         << setw(11) << (result.saturated ? "yes" : "no") << endl;
+    cout.unsetf(ios::floatfield);
+}
+
+
+/*
+Prints the counters of the anytime fit over all detector units, and for the units with the most overruns.
+*/
+void print_budget_stats(const map<int,BudgetStats>& unit_budget_stats){
+    // Number of units listed
+    int n_units_worst = 5;
+
+    BudgetStats total;
+    vector< pair<double,int> > overrun_fractions;
+    for (const auto& [unit,stats] : unit_budget_stats){
+        total.n_fits += stats.n_fits;
+        total.n_overruns += stats.n_overruns;
+        total.sum_completion_fraction += stats.sum_completion_fraction;
+        overrun_fractions.push_back({(double)stats.n_overruns/stats.n_fits,unit});
+    }
+    sort(overrun_fractions.rbegin(),overrun_fractions.rend());
+
+    cout << fixed << setprecision(2);
+    cout << "Anytime fit: " << total.n_fits << " fits, " << 100.*total.n_overruns/total.n_fits << "% budget overruns, "
+         << 100*total.sum_completion_fraction/total.n_fits << "% mean completion" << endl;
+    cout << "Units with most overruns (unit: overruns, mean completion):";
+    for (int i=0; i<min(n_units_worst,(int)overrun_fractions.size()); i++){
+        const BudgetStats& stats = unit_budget_stats.at(overrun_fractions[i].second);
+        cout << " " << overrun_fractions[i].second << ": " << 100*overrun_fractions[i].first << "%, "
+             << 100*stats.sum_completion_fraction/stats.n_fits << "%;";
+    }
+    cout << endl;
+    cout.unsetf(ios::floatfield);
+}
+
+
+int main(int argc, char* argv[]){
+    Options options(argc,argv);
+
+    string template_file = options.get("templates",string("templates_96_XY_rfv2.txt"));
+    int n_threads = options.get("threads",1.);
+    string mode = options.get("mode",string("fixed"));
+    if (mode != "fixed" && mode != "ramp"){
+        cerr << "Unknown mode: " << mode << endl;
+        return 1;
+    }
+    double duration = options.get("duration",2.);
+    size_t size_buffer = options.get("buffer",1024.);
+    double max_latency = options.get("max-latency",10.);
+
+    // One TemplateFLT shared by all worker threads and both polarizations
+    TemplateFLT flt(template_file);
+
+    // Decision stage with per-unit and per-channel thresholds, spread uniformly around the threshold
+    int n_units = options.get("units",100.);
+    float corr_thresh = options.get("corr-thresh",0.7);
+    float thresh_spread = options.get("thresh-spread",0.);
+    size_t size_batch = max(1.,options.get("batch",1.));
+    mt19937 rng_thresh( (unsigned int)options.get("seed",1.) + 1 );
+    uniform_real_distribution<float> thresh_dist(corr_thresh-thresh_spread,corr_thresh+thresh_spread);
+    auto random_thresh = [&](){ return clamp(thresh_dist(rng_thresh),0.f,1.f); };
+
+    ThresholdTable table = make_threshold_table(n_units,2,corr_thresh);
+    if (thresh_spread > 0){
+        for (int i=0; i<table.thresholds.size(); i++){
+            table.thresholds(i) = random_thresh();
+        }
+    }
+    DecisionStage decision_stage(table);
+    if (options.has("thresholds")){
+        decision_stage.load_thresholds( options.get("thresholds",string()) );
+    }
+
+    // Pre-filter in front of the template fit of `trigger`
+    // Its subspace cut is derived from the lowest threshold that the table can hold during the run,
+    // such that it never vetoes a trace that passes the threshold of its unit and channel
+    float corr_thresh_min = decision_stage.get_table()->thresholds.minCoeff();
+    if (options.get("thresh-update-ms",0.) > 0){
+        corr_thresh_min = min(corr_thresh_min,clamp(corr_thresh-thresh_spread,0.f,1.f));
+    }
+    flt.set_corr_thresh(corr_thresh_min);
+
+    string prefilter = options.get("prefilter",string("off"));
+    if (prefilter != "off" && prefilter != "on" && prefilter != "verify"){
+        cerr << "Unknown pre-filter mode: " << prefilter << endl;
+        return 1;
+    }
+    PreFilterConfig prefilter_config;
+    prefilter_config.enabled = prefilter != "off";
+    prefilter_config.verify = prefilter == "verify";
+    prefilter_config.n_components = options.get("prefilter-components",16.);
+    flt.set_prefilter_config(prefilter_config);
+
+
+    string engine = options.get("engine",string("reference"));
+    bool engine_found = engine == "auto";
+    for (const FitEngine& fit_engine : get_fit_engines()){
+        if (fit_engine_name(fit_engine) == engine){
+            flt.set_fit_engine(fit_engine);
+            engine_found = true;
+        }
+    }
+    if (!engine_found){
+        cerr << "Unknown engine: " << engine << endl;
+        return 1;
+    }
+    flt.set_size_block( options.get("size-block",0.) );
+    flt.set_time_budget( 1e3*options.get("budget-us",0.) );
+    flt.set_n_phases( options.get("n-phases",0.) );
+
+    // Select the fastest engine for this configuration and CPU
+    if (engine == "auto"){
+        AutotuneConfig autotune_config;
+        autotune_config.enabled = true;
+        autotune_config.cache_file = options.get("autotune-cache",autotune_config.cache_file);
+        flt.set_autotune_config(autotune_config);
+        engine = "auto/" + fit_engine_name( flt.get_fit_engine() );
+    }
+
+    // One scratch per polarization and per worker thread
+    vector< pair<FitScratch,FitScratch> > scratches(n_threads,make_pair(flt.make_scratch(),flt.make_scratch()));
+
+    vector<Event> pool = generate_pool(flt,options);
+    mt19937 rng( (unsigned int)options.get("seed",1.) );
+
+    // Monitoring thread that publishes a new threshold of a random unit and channel at a fixed period
+    double thresh_update_ms = options.get("thresh-update-ms",0.);
+    atomic<bool> monitoring_done(false);
+    thread monitoring;
+    if (thresh_update_ms > 0){
+        monitoring = thread([&](){
+            while (!monitoring_done){
+                this_thread::sleep_for( chrono::duration<double,milli>(thresh_update_ms) );
+                decision_stage.set_threshold(rng_thresh() % n_units,rng_thresh() % 2,0,random_thresh());
+            }
+        });
+    }
+
+    double rate_flt0 = options.get("units",100.)*options.get("flt0-rate",100.);
+
+    // ID of the next dispatched event
+    uint64_t event_id = 0;
+
+    // Counters of the anytime fit per detector unit
+    map<int,BudgetStats> unit_budget_stats;
+
+    // Result journal
+    // One journal ring per worker thread, no journaling if null
+    unique_ptr<Journal> journal;
+    vector<JournalRing*> journal_rings(n_threads,nullptr);
+    if (options.has("journal")){
+        journal = make_unique<Journal>( options.get("journal",string()) );
+        for (int w=0; w<n_threads; w++){
+            journal_rings[w] = journal->register_writer();
+        }
+    }
+
+    cout << endl << "*** LOAD GENERATOR: " << template_file << ", " << engine << " engine, " << n_threads << " thread(s), "
+         << pool.size() << " events in pool, total FLT-0 rate " << rate_flt0 << " Hz ***" << endl;
+    cout << setw(12) << "rate [Hz]" << setw(12) << "thru [Hz]" << setw(10) << "events" << setw(10) << "dropped"
+         << setw(10) << "triggers" << setw(10) << "p50 [ms]" << setw(10) << "p90 [ms]" << setw(10) << "p99 [ms]"
+         << setw(10) << "p99.9[ms]" << setw(11) << "saturated" << endl;
+
+    if (mode == "fixed"){
+        double rate = options.get("rate",rate_flt0);
+        print_step( run_step(flt,scratches,decision_stage,size_batch,pool,rate,duration,size_buffer,max_latency,rng,event_id,journal_rings,unit_budget_stats) );
+    }
+    else if (mode == "ramp"){
+        double rate = options.get("rate-start",1000.);
+        double rate_step = options.get("rate-step",1000.);
+        double rate_max = options.get("rate-max",1e6);
+
+        // Last rate at which the trigger was not saturated
+        double rate_sustained = 0;
+        bool saturated = false;
+        while (rate <= rate_max && !saturated){
+            StepResult result = run_step(flt,scratches,decision_stage,size_batch,pool,rate,duration,size_buffer,max_latency,rng,event_id,journal_rings,unit_budget_stats);
+            print_step(result);
+            saturated = result.saturated;
+            if (!saturated){
+                rate_sustained = rate;
+            }
+            rate += rate_step;
+        }
+
+        if (saturated){
+            cout << fixed << setprecision(0);
+            cout << "Saturation point: " << rate_sustained << " Hz sustained with " << n_threads << " thread(s)" << endl;
+        }
+        else{
+            cout << fixed << setprecision(0);
+            cout << "No saturation up to " << rate_sustained << " Hz with " << n_threads << " thread(s)" << endl;
+        }
+    }
+
+    if (monitoring.joinable()){
+        monitoring_done = true;
+        monitoring.join();
+    }
+    cout << "Threshold table: version " << decision_stage.get_table()->version << ", batches of up to " << size_batch << " events" << endl;
+
+    if (!unit_budget_stats.empty()){
+        print_budget_stats(unit_budget_stats);
+    }
+
+    if (prefilter_config.enabled){
+        // Counters of the pre-filter over all workers and polarizations
+        PreFilterStats stats;
+        for (const pair<FitScratch,FitScratch>& scratch : scratches){
+            for (const PreFilterStats& stats_scratch : {scratch.first.prefilter_stats,scratch.second.prefilter_stats}){
+                stats.n_evaluated += stats_scratch.n_evaluated;
+                stats.n_rejected += stats_scratch.n_rejected;
+                stats.n_verified += stats_scratch.n_verified;
+                stats.n_false_vetoes += stats_scratch.n_false_vetoes;
+            }
+        }
+        cout << "Pre-filter: " << stats.n_evaluated << " traces evaluated, " << stats.n_rejected << " rejected (min_corr_subspace = "
+             << PreFilter(flt.templates_desampled,prefilter_config,corr_thresh_min).get_min_corr_subspace() << ")";
+        if (prefilter_config.verify){
+            cout << ", " << stats.n_verified << " verified, " << stats.n_false_vetoes << " false vetoes";
+        }
+        cout << endl;
+    }
+
+    if (journal){
+        if (!journal->close()){
+            cerr << "Journal stopped by an I/O error: " << journal->get_error() << endl;
+        }
+        cout << "Journal: " << journal->get_n_written() << " records written, " << journal->get_n_dropped() << " dropped" << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+//////////////////////////////////////
+//** TRACE GENERATOR SOURCE FILE ** //
+//////////////////////////////////////
+
+#include <cmath>
+#include "trace_generator.h"
+#include "error_handling.h"
+
+using namespace std;
+
+/*
+------------
+CONSTRUCTORS
+------------
+*/
+
+/*
+Constructor that seeds the random number generator.
+
+Arguments
+---------
+`seed` : Seed of the random number generator. Default is 0.
+*/
+TraceGenerator::TraceGenerator(const unsigned int& seed){
+    this->rng.seed(seed);
+}
+
+
+/*
+-------
+METHODS
+-------
+*/
+
+/*
+Draws a random integer uniformly between [min,max].
+*/
+int TraceGenerator::uniform_int(const int& min,
+                                const int& max){
+    uniform_int_distribution<int> dist(min,max);
+
+    return dist(rng);
+}
+
+
+/*
+Draws a random float uniformly between [min,max).
+*/
+float TraceGenerator::uniform(const float& min,
+                              const float& max){
+    uniform_real_distribution<float> dist(min,max);
+
+    return dist(rng);
+}
+
+
+/*
+Draws a random float from a normal distribution.
+*/
+float TraceGenerator::normal(const float& mean,
+                             const float& sigma){
+    normal_distribution<float> dist(mean,sigma);
+
+    return dist(rng);
+}
+
+
+/*
+Creates a trace of Gaussian noise.
+
+Arguments
+---------
+`size_trace` : Number of samples of the trace.
+
+`sigma` : Standard deviation of the noise [ADC counts].
+
+`offset` : Pedestal offset of the trace [ADC counts]. Default is 0.
+
+Returns
+-------
+`trace` : The noise trace.
+*/
+Eigen::ArrayXf TraceGenerator::noise(const int& size_trace,
+                                     const float& sigma,
+                                     const float& offset){
+    Eigen::ArrayXf trace(size_trace);
+
+    normal_distribution<float> dist(offset,sigma);
+    for (int i=0; i<size_trace; i++){
+        trace(i) = dist(rng);
+    }
+
+    return trace;
+}
+
+
+/*
+Adds narrow-band radio-frequency interference (RFI) to a trace, modelled as a sine wave.
+
+Arguments
+---------
+`trace` : The trace to which the RFI is added.
+
+`frequency` [MHz] : Frequency of the RFI line.
+
+`amplitude` : Amplitude of the RFI line [ADC counts].
+
+`phase` [rad] : Phase of the RFI line at the first sample of the trace.
+
+`adc_sampling_rate` [MHz] : Sampling rate of the ADC. Default is 500 MHz.
+*/
+void TraceGenerator::add_rfi(Eigen::ArrayXf& trace,
+                             const float& frequency,
+                             const float& amplitude,
+                             const float& phase,
+                             const int& adc_sampling_rate){
+    float omega = 2*M_PI*frequency/adc_sampling_rate;
+
+    for (int i=0; i<trace.size(); i++){
+        trace(i) += amplitude*sin(omega*i + phase);
+    }
+
+    return;
+}
+
+
+/*
+Injects a desampled template into a trace.
+The template is desampled in the same way as `TemplateFLT::desample_templates`.
+Samples of the template that fall outside of the trace are dropped,
+such that pulses near the edges of the trace are only partially injected.
+
+Arguments
+---------
+`trace` : The trace in which the template is injected.
+
+`templ` : Template at the simulation sampling rate.
+
+`desampling_factor` : Simulation sampling rate / ADC sampling rate.
+
+`idx_desampled` : Index of the desampling (phase) of the template. Must be between [0,desampling_factor).
+
+`sample_peak_template` : Sample of the peak position of `templ` (simulation sampling rate).
+
+`t_peak` : Sample of `trace` where the template peak is injected.
+
+`amplitude` : Amplitude with which the template is scaled [ADC counts].
+*/
+void TraceGenerator::inject_template(Eigen::ArrayXf& trace,
+                                     const Eigen::ArrayXf& templ,
+                                     const int& desampling_factor,
+                                     const int& idx_desampled,
+                                     const int& sample_peak_template,
+                                     const int& t_peak,
+                                     const float& amplitude){
+    // Check that the phase is valid
+    if (idx_desampled < 0 || idx_desampled >= desampling_factor){
+        string err_msg = "Desampling index " + to_string(idx_desampled) + " must be between [0," + to_string(desampling_factor) + ")!";
+        throwError(err_msg,__FILE__,__LINE__);
+    }
+
+    // Sample of the trace where the desampled template starts
+    int sample_start = t_peak - sample_peak_template/desampling_factor;
+
+    // Loop over all samples of the desampled template
+    for (int n=0; idx_desampled+n*desampling_factor<templ.size(); n++){
+        int sample = sample_start + n;
+        if (sample < 0 || sample >= trace.size()){
+            continue;
+        }
+        trace(sample) += amplitude*templ(idx_desampled+n*desampling_factor);
+    }
+
+    return;
+}
+
+
+/*
+Digitizes a trace by rounding it to integer ADC counts.
+
+Arguments
+---------
+`trace` : The trace to digitize.
+
+Returns
+-------
+`trace_adc` : The digitized trace.
+*/
+Eigen::ArrayXi TraceGenerator::digitize(const Eigen::ArrayXf& trace){
+    Eigen::ArrayXi trace_adc = trace.round().cast<int>();
+
+    return trace_adc;
+}
@@ -0,0 +1,70 @@
+/*
+//////////////////////////////////////
+//** TRACE GENERATOR HEADER FILE ** //
+//////////////////////////////////////
+
+This file defines a generator of synthetic ADC traces.
+Traces are built by injecting templates of the template library
+with a given phase, amplitude and peak position into Gaussian noise with a pedestal offset,
+optionally with narrow-band radio-frequency interference (RFI).
+The generator is used to validate and benchmark the template-fitting code.
+*/
+
+#ifndef TRACE_GENERATOR_H
+#define TRACE_GENERATOR_H
+
+#include <random>
+#include <eigen3/Eigen/Dense>
+
+class TraceGenerator{
+    private:
+        /*
+        ------------------
+        PRIVATE ATTRIBUTES
+        ------------------
+        */
+
+        // Random number generator
+        std::mt19937 rng;
+
+    public:
+        /*
+        ------------
+        CONSTRUCTORS
+        ------------
+        */
+
+        TraceGenerator(const unsigned int& seed = 0);
+
+        /*
+        --------------
+        PUBLIC METHODS
+        --------------
+        */
+
+        int uniform_int(const int& min,
+                        const int& max);
+        float uniform(const float& min,
+                      const float& max);
+        float normal(const float& mean,
+                     const float& sigma);
+
+        Eigen::ArrayXf noise(const int& size_trace,
+                             const float& sigma,
+                             const float& offset = 0);
+        void add_rfi(Eigen::ArrayXf& trace,
+                     const float& frequency,
+                     const float& amplitude,
+                     const float& phase,
+                     const int& adc_sampling_rate = 500);
+        void inject_template(Eigen::ArrayXf& trace,
+                             const Eigen::ArrayXf& templ,
+                             const int& desampling_factor,
+                             const int& idx_desampled,
+                             const int& sample_peak_template,
+                             const int& t_peak,
+                             const float& amplitude);
+        Eigen::ArrayXi digitize(const Eigen::ArrayXf& trace);
+};
+
+#endif // TRACE_GENERATOR_H
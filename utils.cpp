@@ -59,7 +59,7 @@ Eigen::ArrayXf correlate(const Eigen::ArrayXf& arr1,
 
     // Normalize all correlation with RMS of arr2 and its length to yield a value between [-1,1]
     if (norm){
-        corr / rms(arr2) / arr2.size();
+        corr = corr / rms(arr2) / arr2.size();
     }
 
     return corr;
@@ -85,6 +85,36 @@ float rms(const Eigen::ArrayXf& arr){
 }
 
 
+/*
+Gets all windows of a trace segment without copy, and computes the RMS of each window.
+The correlations of all windows with several templates are then computed in a single matrix product.
+
+Arguments
+---------
+`segment` : Trace segment of size N >= `size_window`. Must outlive the windows.
+
+`size_window` : Number of samples of a window, i.e. of a template.
+
+`rms_windows` : Set to the RMS of each window. Its buffer is reused.
+
+Returns
+-------
+`windows` : Matrix of size (`size_window`, N - `size_window` + 1), whose column k is the window starting at sample k.
+*/
+SegmentWindows get_windows(const Eigen::ArrayXf& segment,
+                           const int& size_window,
+                           Eigen::ArrayXf& rms_windows){
+    // Number of windows
+    int n_windows = segment.size() - size_window + 1;
+
+    SegmentWindows windows(segment.data(),size_window,n_windows,Eigen::OuterStride<>(1));
+
+    rms_windows = ( windows.colwise().squaredNorm().transpose().array() / size_window ).sqrt();
+
+    return windows;
+}
+
+
 /*
 Normalizes an array between [-1,1], i.e. with respect to the maximum value of abs(array).
 
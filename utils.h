@@ -14,6 +14,15 @@ This file defines some utils that are used in the template fitting code.
 #include <fstream>
 #include <eigen3/Eigen/Dense>
 
+/*
+-----
+TYPES
+-----
+*/
+
+// Windows of a trace segment, without copy: column k is the window starting at sample k, see `get_windows`
+typedef Eigen::Map< const Eigen::MatrixXf, 0, Eigen::OuterStride<> > SegmentWindows;
+
 /*
 ---------
 FUNCTIONS
@@ -26,6 +35,10 @@ Eigen::ArrayXf correlate(const Eigen::ArrayXf& arr1,
 
 float rms(const Eigen::ArrayXf& arr);
 
+SegmentWindows get_windows(const Eigen::ArrayXf& segment,
+                           const int& size_window,
+                           Eigen::ArrayXf& rms_windows);
+
 Eigen::ArrayXf normalize(const Eigen::ArrayXf& arr);
 
 std::vector<Eigen::ArrayXi> load_test_trace(std::string test_trace_file_name);